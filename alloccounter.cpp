@@ -0,0 +1,84 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// alloccounter.cpp
+// count the heap allocations in debug and benchmark builds
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "alloccounter.h"
+#include <stdlib.h>
+
+#if defined(DT_ANNOTATE_COUNT_ALLOCS) && defined(__GLIBC__)
+#define COUNT_ALLOCS
+#include <atomic>
+
+namespace {
+
+std::atomic<qint64> allocs(0);
+// a plain variable in the static TLS block, no allocation on first use
+thread_local qint64 threadAllocs = 0;
+
+} // namespace
+
+// the allocation functions of the C library are replaced for the whole
+// process, Qt and the C++ runtime included
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t n, size_t size);
+void *__libc_realloc(void *p, size_t size);
+
+void *malloc(size_t size)
+{
+    allocs.fetch_add(1, std::memory_order_relaxed);
+    ++threadAllocs;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    allocs.fetch_add(1, std::memory_order_relaxed);
+    ++threadAllocs;
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t size)
+{
+    allocs.fetch_add(1, std::memory_order_relaxed);
+    ++threadAllocs;
+    return __libc_realloc(p, size);
+}
+
+} // extern "C"
+#endif
+
+bool AllocCounter::enabled()
+{
+#ifdef COUNT_ALLOCS
+    return true;
+#else
+    return false;
+#endif
+}
+
+qint64 AllocCounter::count()
+{
+#ifdef COUNT_ALLOCS
+    return allocs.load(std::memory_order_relaxed);
+#else
+    return 0;
+#endif
+}
+
+qint64 AllocCounter::threadCount()
+{
+#ifdef COUNT_ALLOCS
+    return threadAllocs;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,30 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// alloccounter.h
+// header file for alloccounter.cpp
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef ALLOCCOUNTER_H
+#define ALLOCCOUNTER_H
+
+#include <QtGlobal>
+
+// number of heap allocations of the whole process. Counted in debug and
+// benchmark builds (DT_ANNOTATE_COUNT_ALLOCS) with the GNU C library only,
+// where malloc() can be replaced by the program
+class AllocCounter
+{
+public:
+    static bool enabled();
+    // malloc(), calloc() and realloc() calls, including operator new
+    static qint64 count();
+    // the same calls of the calling thread only
+    static qint64 threadCount();
+};
+
+#endif // ALLOCCOUNTER_H
@@ -10,120 +10,211 @@
 // 2021-6-8  tt  Initial version created
 // ***************************************************************************
 #include "annotate.h"
+#include "alloccounter.h"
+#include "compressedstream.h"
+#include "dtbreader.h"
+#include "propertytable.h"
 #include <QFile>
+#include <QFileInfo>
 #include <QMessageLogger>
 #include <QDebug>
 #include <stdarg.h>
+#include <ctype.h>
+#include <string.h>
+#include <limits.h>
 #include <QCoreApplication>
 #include <QDateTime>
+#include <QThread>
+#include <QThreadPool>
+#include <QTemporaryFile>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QSaveFile>
+#include <algorithm>
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+namespace {
+
+const char *stageNames[Annotate::StageCount] = { "read", "split", "scan", "merge", "resolve", "write" };
+
+// property handlers in the statistics, "plain" is split into numeric and other
+const char *handlerKeys[PropertyTable::HandlerCount] = {
+    "other", "singleHandle", "firstHandle", "gpio", "listHandle", "clocks",
+    "rockchipPins", "rockchipPowerCtrl", "interrupts", "interruptMap"
+};
+const char *handlerNames[PropertyTable::HandlerCount] = {
+    "other", "single handle", "first handle", "gpio", "list handle", "clocks",
+    "rockchip,pins", "rockchip,power-ctrl", "interrupts", "interrupt-map"
+};
+
+// symbolic cell values by number
+const char *gpioTypes[] = { "GPIO_ACTIVE_HIGH", "GPIO_ACTIVE_LOW", "GPIO_OPEN_SOURCE", "GPIO_OPEN_DRAIN" };
+const char *irqTypes[] = {
+    "IRQ_TYPE_NONE", "IRQ_TYPE_EDGE_RISING", "IRQ_TYPE_EDGE_FALLING", "IRQ_TYPE_EDGE_BOTH",
+    "IRQ_TYPE_LEVEL_HIGH", nullptr, nullptr, nullptr, "IRQ_TYPE_LEVEL_LOW"
+};
+
+// cache file of the incremental mode
+const quint32 cacheMagic = 0x64746163;  // "dtac"
+const qint32 cacheVersion = 2;
+
+// slots of the cache of annotated lines, a power of two, and the size of
+// the storage of a slot: the longest line, annotated line and the most
+// patches kept in it
+const int cacheSlots = 4096;
+const int maxCachedLine = 256;
+const int maxCachedOut = 512;
+const int maxCachedPatches = 16;
+
+// phandle of a reference that is resolved when an overlay is applied
+const quint32 unresolvedHandle = 0xffffffff;
+
+// counters of a cache file, none of them can be negative
+bool isValid(const Annotate::Statistics &s)
+{
+    bool valid = (s.bytesIn >= 0) && (s.bytesOut >= 0) && (s.lines >= 0) && (s.nodes >= 0)
+            && (s.numeric >= 0) && (s.labels >= 0) && (s.resolved >= 0) && (s.unresolved >= 0)
+            && (s.cacheLookups >= 0) && (s.cacheHits >= 0) && (s.peakMemory >= 0) && (s.propertyAllocations >= 0)
+            && (s.nodeAllocations >= 0);
+    for (int n : s.properties)
+        valid = valid && (n >= 0);
+    for (auto t : s.stageTime)
+        valid = valid && (t >= 0);
+    return valid;
+}
+
+// the text within a range of a line, without a temporary string
+bool containsText(const char *p, int len, const char *text)
+{
+    const char *end = p + len;
+    return std::search(p, end, text, text + strlen(text)) != end;
+}
+
+// shrink a range of a line to its text without leading and trailing blanks
+void trimRange(const QByteArray &line, int *from, int *to)
+{
+    while ((*from < *to) && isspace(static_cast<uchar>(line.at(*from))))
+        ++*from;
+    while ((*to > *from) && isspace(static_cast<uchar>(line.at(*to - 1))))
+        --*to;
+}
+
+// peak resident size of the process in bytes, 0 if unknown
+qint64 peakMemory()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS pmc;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc)))
+        return static_cast<qint64>(pmc.PeakWorkingSetSize);
+    return 0;
+#elif defined(Q_OS_UNIX)
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) != 0)
+        return 0;
+#ifdef Q_OS_DARWIN
+    return ru.ru_maxrss;
+#else
+    // kilobytes
+    return static_cast<qint64>(ru.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+} // namespace
 
 Annotate::Annotate(bool beQuiet)
     : m_beQuiet(beQuiet)
     , m_lastError(noError)
+    , m_threads(1)
+    , m_maxMemory(64*1024*1024)
+    , m_stats()
+    , m_incremental(false)
+    , m_cacheLoaded(false)
+    , m_pathReferences(false)
+    , m_allocCount(0)
+    , m_overlay(false)
 {
-    m_singleHandleParams << "arasan,soc-ctl-syscon";
-    m_singleHandleParams << "audio-supply";
-    m_singleHandleParams << "backlight";
-    m_singleHandleParams << "bt656-supply";
-    m_singleHandleParams << "center-supply";
-    m_singleHandleParams << "charge-dev";
-    m_singleHandleParams << "connect";
-    m_singleHandleParams << "ddr_timing";
-    m_singleHandleParams << "devfreq";
-    m_singleHandleParams << "devfreq-events";
-    m_singleHandleParams << "extcon";
-    m_singleHandleParams << "gpio1830-supply";
-    m_singleHandleParams << "interrupt-parent";
-    m_singleHandleParams << "iommus";
-    m_singleHandleParams << "logo-memory-region";
-    m_singleHandleParams << "mali-supply";
-    m_singleHandleParams << "memory-region";
-    m_singleHandleParams << "mmc-pwrseq";
-    m_singleHandleParams << "native-mode";
-    m_singleHandleParams << "operating-points-v2";
-    m_singleHandleParams << "phy-supply";
-    m_singleHandleParams << "pmu1830-supply";
-    m_singleHandleParams << "rockchip,pmu";
-    m_singleHandleParams << "sdmmc-supply";
-    m_singleHandleParams << "remote-endpoint";
-    m_singleHandleParams << "rockchip,cpu";
-    m_singleHandleParams << "rockchip,grf";
-    m_singleHandleParams << "rockchip-serial-irq";
-    m_singleHandleParams << "secure-memory-region";
-    m_singleHandleParams << "simple-audio-card,mclk-fs";
-    m_singleHandleParams << "sound-dai";
-    m_singleHandleParams << "trip";
-    m_singleHandleParams << "vbus-supply";
-    m_singleHandleParams << "vcc1-supply";
-    m_singleHandleParams << "vcc10-supply";
-    m_singleHandleParams << "vcc11-supply";
-    m_singleHandleParams << "vcc12-supply";
-    m_singleHandleParams << "vcc2-supply";
-    m_singleHandleParams << "vcc3-supply";
-    m_singleHandleParams << "vcc4-supply";
-    m_singleHandleParams << "vcc5-supply";
-    m_singleHandleParams << "vcc6-supply";
-    m_singleHandleParams << "vcc7-supply";
-    m_singleHandleParams << "vcc8-supply";
-    m_singleHandleParams << "vcc9-supply";
-    m_singleHandleParams << "vddio-supply";
-    m_singleHandleParams << "vin-supply";
-    m_singleHandleParams << "vmmc-supply";
-    m_singleHandleParams << "vqmmc-supply";
-    m_singleHandleParams << "vref-supply";
-
-    m_firstHandleParams << "assigned-clock-parents";
-    m_firstHandleParams << "cooling-device";
-    m_firstHandleParams << "discharge-gpios";
-    m_firstHandleParams << "ep-gpios";
-    m_firstHandleParams << "gpio";
-    m_firstHandleParams << "gpios";
-    m_firstHandleParams << "headset_gpio";
-    m_firstHandleParams << "hp_ctrl_gpio";
-    m_firstHandleParams << "int-n-gpios";
-    m_firstHandleParams << "io-channels";
-    m_firstHandleParams << "linein_det_gpio";
-    m_firstHandleParams << "power-domains";
-    m_firstHandleParams << "pwms";
-    m_firstHandleParams << "reset-gpios";
-    m_firstHandleParams << "rockchip,gpios";
-    m_firstHandleParams << "snps,reset-gpio";
-    m_firstHandleParams << "thermal-sensors";
-    m_firstHandleParams << "typec0-enable-gpios";
-    m_firstHandleParams << "vbus-5v-gpios";
-    m_firstHandleParams << "vsel-gpios";
-
-    m_listHandleParams << "nvmem-cells";
-    m_listHandleParams << "phys";
-    m_listHandleParams << "pinctrl-0";
-    m_listHandleParams << "pinctrl-1";
-    m_listHandleParams << "pinctrl-2";
-    m_listHandleParams << "pinctrl-3";
-    m_listHandleParams << "pinctrl-4";
-    m_listHandleParams << "pinctrl-5";
-    m_listHandleParams << "pm_qos";
-    m_listHandleParams << "ports";
-    m_listHandleParams << "rockchip,codec";
+    m_pool.setMaxThreadCount(m_threads);
+}
+
+Annotate::~Annotate()
+{
+    qDeleteAll(m_states);
 }
 
 bool Annotate::process(const QString &fnIn, const QString &fnOut)
 {
-    QFile fIn(fnIn);
-    if (fIn.exists()) {
-        if (fIn.open(QFile::ReadOnly)) {
-            QByteArray src = fIn.readAll();
-            if (src.isEmpty()) {
+    m_stats = Statistics();
+    m_lastError = noError;
+    m_edges.clear();
+    if ((fnIn == "-") || (fnOut == "-")) {
+        // the cache and the fixups need the whole file at once
+        if (m_incremental || m_base) {
+            m_lastError = StreamNotSupported;
+            return false;
+        }
+        return processStream(fnIn, fnOut);
+    }
+    QElapsedTimer timer;
+    timer.start();
+    m_allocCount = AllocCounter::count();
+    if (QFile::exists(fnIn)) {
+        SourceBuffer src;
+        if (src.open(fnIn)) {
+            bool compressed = Compression::fromData(src.data(), src.size()) != Compression::None;
+            if (compressed && !m_incremental && !m_base && (m_threads <= 1)) {
+                // streamed like standard input, unless it turns out to be an
+                // overlay, whose fixups need the whole file
+                src.close();
+                bool overlay = false;
+                if (processStream(fnIn, fnOut, &overlay))
+                    return true;
+                if (!overlay)
+                    return false;
+                m_stats = Statistics();
+                m_lastError = noError;
+                m_edges.clear();
+                timer.restart();
+            }
+            if (!compressed && src.isEmpty()) {
                 m_lastError = InputFileReadError;
             } else {
-                // input file read successfully
-                log("read %u bytes from \"%s\"", src.size(), qPrintable(fnIn));
-                ByteArrayList tsIn = src.split('\n');
-                // create symbol table
-                StringHash symbols = createSymbolHash(tsIn);
-                // create phandle map
-                StringHash handles = createHandleHash(tsIn);
-                // replace numeric handles by symbols and write output file
-                return writeOutput(fnOut, tsIn, symbols, handles);
+                QVector<Chunk> chunks;
+                if (compressed) {
+                    // split and scanned while it is decompressed
+                    if (!annotateCompressed(fnIn, &src, &chunks, &timer))
+                        return false;
+                } else {
+                    // input file mapped successfully
+                    log("read %d bytes from \"%s\"", src.size(), qPrintable(fnIn));
+                    m_stats.bytesIn = src.size();
+                    if (!annotateSource(&src, &chunks, &timer))
+                        return false;
+                }
+                bool ok = writeOutput(fnOut, &chunks);
+                if (m_stats.unresolved > 0)
+                    log("%d phandle references without symbol", m_stats.unresolved);
+                if (ok && !m_cacheFile.isEmpty() && !saveCache()) {
+                    m_lastError = CacheFileWriteError;
+                    ok = false;
+                }
+                if (ok && !m_xrefFile.isEmpty() && !writeXref(chunks)) {
+                    m_lastError = XrefFileWriteError;
+                    ok = false;
+                }
+                endStage(WriteStage, &timer);
+                m_stats.peakMemory = peakMemory();
+                return ok;
             }
         } else {
             m_lastError = InputFileOpenError;
@@ -134,6 +225,381 @@ bool Annotate::process(const QString &fnIn, const QString &fnOut)
     return false;
 }
 
+bool Annotate::annotate(const QByteArray &in, QByteArray *out)
+{
+    m_stats = Statistics();
+    m_lastError = noError;
+    m_edges.clear();
+    QElapsedTimer timer;
+    timer.start();
+    m_allocCount = AllocCounter::count();
+    if (in.isEmpty()) {
+        m_lastError = InputFileReadError;
+        return false;
+    }
+    // the source shares the data of the input
+    SourceBuffer src;
+    src.setData(in);
+    m_stats.bytesIn = in.size();
+    QVector<Chunk> chunks;
+    if (!annotateSource(&src, &chunks, &timer))
+        return false;
+    QByteArray header;
+    writeHeader(&header);
+    m_stats.bytesOut += header.size();
+    // a little larger than the input
+    out->clear();
+    out->reserve(header.size() + in.size() + in.size()/8);
+    *out += header;
+    emitChunks(&chunks, [out](const QByteArray &block) -> bool {
+        *out += block;
+        return true;
+    });
+    if (m_stats.unresolved > 0)
+        log("%d phandle references without symbol", m_stats.unresolved);
+    bool ok = true;
+    if (!m_cacheFile.isEmpty() && !saveCache()) {
+        m_lastError = CacheFileWriteError;
+        ok = false;
+    }
+    if (ok && !m_xrefFile.isEmpty() && !writeXref(chunks)) {
+        m_lastError = XrefFileWriteError;
+        ok = false;
+    }
+    endStage(WriteStage, &timer);
+    m_stats.peakMemory = peakMemory();
+    return ok;
+}
+
+bool Annotate::decompile(SourceBuffer *src)
+{
+    if (DtbReader::isBlob(src->data(), src->size())) {
+        // flattened device tree, decompile it first
+        QByteArray dts;
+        DtbReader dtb;
+        if (!dtb.toSource(src->data(), src->size(), &dts)) {
+            m_lastError = InputFormatError;
+            return false;
+        }
+        log("decompiled device tree blob to %d bytes", dts.size());
+        src->setData(dts);
+    }
+    return true;
+}
+
+bool Annotate::annotateSource(SourceBuffer *src, QVector<Chunk> *chunks, QElapsedTimer *timer)
+{
+    if (!decompile(src))
+        return false;
+    m_stats.lines = src->lineCount();
+    loadFixups(*src);
+    prepareCache();
+    endStage(ReadStage, timer);
+    // annotate all lines in a single pass, references to
+    // symbols and phandles are resolved afterwards. Large files
+    // are split into chunks that are annotated concurrently
+    *chunks = splitChunks(*src);
+    if (m_incremental)
+        reuseChunks(chunks);
+    endStage(SplitStage, timer);
+    runChunks(chunks, [this, src](Chunk *c) {
+        if (!c->cached)
+            scanChunk(*src, c);
+    });
+    return finishChunks(src, chunks, timer);
+}
+
+bool Annotate::annotateCompressed(const QString &fn, SourceBuffer *src, QVector<Chunk> *chunks, QElapsedTimer *timer)
+{
+    // the lines are indexed and cut into chunks block by block while the
+    // next block is decompressed on the thread of the stream. A single
+    // thread scans every chunk as soon as it is cut, several threads scan
+    // all of them at the end
+    StreamInput in;
+    if (!in.open(fn)) {
+        m_lastError = (in.status() == StreamUnsupported) ? CompressionNotSupported : InputFileOpenError;
+        return false;
+    }
+    log("decompressing %s input", Compression::name(in.format()));
+    // a source compresses about ten times, the pages that are reserved
+    // but never written are not committed
+    int estimate = static_cast<int>(qMin<qint64>(QFileInfo(fn).size() * 12, 1024*1024*1024));
+    src->close();
+    src->reserve(estimate);
+    // the fixups and the cache are needed before the first chunk is
+    // scanned, the fixups are read once more at the end
+    m_fixups.clear();
+    m_localFixups.clear();
+    m_overlay = !m_base.isNull();
+    bool scanNow = m_incremental && (m_threads <= 1) && !m_overlay;
+    prepareCache();
+    SplitState s;
+    // lines of about 32 bytes
+    beginSplit(&s, estimate / 32);
+    chunks->clear();
+    QByteArray buf(1024*1024, Qt::Uninitialized);
+    int scanned = 0;
+    int reused = 0;
+    bool checked = false;
+    bool blob = false;
+    qint64 n;
+    while ((n = in.read(buf.data(), buf.size())) > 0) {
+        src->append(buf.constData(), static_cast<int>(n));
+        if (!checked) {
+            if (src->size() < 40)
+                continue;
+            checked = true;
+            // a blob is decompiled as a whole, it is much smaller than the source
+            blob = DtbReader::isBlob(src->data(), src->size());
+        }
+        if (blob)
+            continue;
+        // all lines but the last one, which may not be complete yet
+        splitLines(*src, src->lineCount() - 1, &s, chunks);
+        for (; scanNow && (scanned < chunks->size()); ++scanned) {
+            Chunk *c = &(*chunks)[scanned];
+            if (reuseChunk(c))
+                ++reused;
+            else
+                scanChunk(*src, c);
+        }
+    }
+    if (in.status() != StreamOk) {
+        m_lastError = (in.status() == StreamDataError) ? CompressionError : InputFileReadError;
+        return false;
+    }
+    if (src->isEmpty()) {
+        m_lastError = InputFileReadError;
+        return false;
+    }
+    log("read %d bytes from \"%s\"", src->size(), qPrintable(fn));
+    m_stats.bytesIn = src->size();
+    if (DtbReader::isBlob(src->data(), src->size()))
+        return annotateSource(src, chunks, timer);
+    m_stats.lines = src->lineCount();
+    loadFixups(*src);
+    endStage(ReadStage, timer);
+    splitLines(*src, src->lineCount(), &s, chunks);
+    if (!endSplit(*src, &s, chunks) || (m_overlay && (scanned > 0))) {
+        // the cache was dropped or the chunks were scanned without the
+        // fixups of an overlay, all of them are split and scanned again
+        *chunks = splitChunks(*src);
+        scanned = 0;
+        reused = 0;
+    }
+    if (m_incremental) {
+        for (int i=scanned; i<chunks->size(); ++i) {
+            if (reuseChunk(&(*chunks)[i]))
+                ++reused;
+        }
+        log("%d of %d top-level nodes unchanged", reused, chunks->size());
+    }
+    endStage(SplitStage, timer);
+    const Chunk *first = chunks->constData();
+    runChunks(chunks, [this, src, first, scanned](Chunk *c) {
+        if (!c->cached && (c - first >= scanned))
+            scanChunk(*src, c);
+    });
+    return finishChunks(src, chunks, timer);
+}
+
+bool Annotate::finishChunks(SourceBuffer *src, QVector<Chunk> *chunks, QElapsedTimer *timer)
+{
+    // the chunks hold all that is left to do, the source is not needed
+    // any more
+    src->close();
+    endStage(ScanStage, timer);
+    mergeTables(*chunks);
+    endStage(MergeStage, timer);
+    if (!m_xrefFile.isEmpty()) {
+        // the references are known until the chunks are resolved
+        for (const auto &c : qAsConst(*chunks))
+            collectReferences(c);
+    }
+    if (m_incremental) {
+        // the cache shares the scanned chunks, resolving detaches them
+        QHash<QByteArray, CacheEntry> next;
+        for (const auto &c : qAsConst(*chunks))
+            next[c.hash].scanned = c;
+        runChunks(chunks, [this](Chunk *c) { resolveIncremental(c); });
+        updateCache(*chunks, &next);
+    }
+    // without the cache the chunks are resolved while they are written,
+    // see emitChunks()
+    endStage(ResolveStage, timer);
+    return true;
+}
+
+void Annotate::prepareCache()
+{
+    if (m_incremental && !m_cacheLoaded) {
+        // a missing or outdated cache file is no error
+        m_cacheLoaded = true;
+        if (!m_cacheFile.isEmpty() && !loadCache())
+            m_cache.clear();
+    }
+}
+
+void Annotate::loadFixups(const SourceBuffer &src)
+{
+    // "__fixups__" and "__local_fixups__" are children of the root node
+    // and usually follow the fragments, so they are read before the lines
+    // are scanned
+    m_fixups.clear();
+    m_localFixups.clear();
+    m_overlay = !m_base.isNull();
+    // most files have neither, the lines are only classified for those
+    // that have
+    if (!QByteArray::fromRawData(src.data(), src.size()).contains("_fixups__"))
+        return;
+    LineWindow lines(src);
+    int n = src.lineCount();
+    int depth = 0;
+    for (int inx=0; inx < n; ++inx) {
+        const LineInfo &info = lines.info(inx);
+        if (info.open > 0) {
+            if (depth == 1) {
+                const QByteArray name = src.line(inx).left(info.open).trimmed();
+                if (name == "__fixups__") {
+                    m_overlay = true;
+                    inx = loadBaseFixups(&lines, inx);
+                    continue;
+                }
+                if (name == "__local_fixups__") {
+                    inx = loadLocalFixups(&lines, inx);
+                    continue;
+                }
+            }
+            ++depth;
+        } else if (info.close >= 0) {
+            --depth;
+        }
+    }
+    if (!m_fixups.isEmpty())
+        log("%d references to the base tree", m_fixups.size());
+    if (!m_localFixups.isEmpty())
+        log("%d properties with references within the overlay", m_localFixups.size());
+}
+
+int Annotate::loadBaseFixups(LineWindow *lines, int inx)
+{
+    // label = "path:property:offset", ...;
+    int n = lines->lineCount();
+    QVector<QByteArray> missing;
+    for (++inx; (inx < n) && (lines->info(inx).close < 0); ++inx) {
+        if (!m_base)
+            continue;
+        const QByteArray l = lines->line(inx);
+        int eq = l.indexOf('=');
+        if (eq < 0)
+            continue;
+        const QByteArray label = l.left(eq).trimmed();
+        const QList<QByteArray> parts = l.mid(eq + 1).split('"');
+        for (int i=1; i<parts.size(); i+=2)
+            m_fixups.insert(parts.at(i), label);
+        if (!m_base->contains(label))
+            missing.append(label);
+    }
+    for (const auto &label : qAsConst(missing))
+        log("label \"%s\" not found in the base tree", label.constData());
+    return inx;
+}
+
+int Annotate::loadLocalFixups(LineWindow *lines, int inx)
+{
+    // the nodes of the overlay once more, with the byte offsets of the
+    // cells that hold a phandle as properties: "clocks = <0x00 0x08>;"
+    int n = lines->lineCount();
+    QByteArray path;
+    QVector<int> parents;
+    for (++inx; inx < n; ++inx) {
+        const LineInfo &info = lines->info(inx);
+        const QByteArray l = lines->line(inx);
+        if (info.open > 0) {
+            parents.append(path.size());
+            path += '/';
+            path += l.left(info.open).trimmed();
+        } else if (info.close >= 0) {
+            if (parents.isEmpty())
+                break;
+            path.truncate(parents.takeLast());
+        } else if ((info.eq >= 0) && (info.lt >= 0)) {
+            QVector<int> &offsets = m_localFixups[(path.isEmpty() ? QByteArray("/") : path) + ':' + l.left(info.eq).trimmed()];
+            int len;
+            int from = CellList::parameters(l, info, &len);
+            for (const auto &x : l.mid(from, len).split(' ')) {
+                bool ok;
+                uint offset = x.toUInt(&ok, 0);
+                if (ok && (offset <= INT_MAX))
+                    offsets.append(static_cast<int>(offset));
+            }
+        }
+    }
+    return inx;
+}
+
+bool Annotate::loadBase(const QString &fn, SymbolTable *symbols)
+{
+    m_lastError = noError;
+    symbols->clear();
+    if (!QFile::exists(fn)) {
+        m_lastError = InputFileNotFound;
+        return false;
+    }
+    SourceBuffer src;
+    if (!src.open(fn)) {
+        m_lastError = InputFileOpenError;
+        return false;
+    }
+    if (src.isEmpty()) {
+        m_lastError = InputFileReadError;
+        return false;
+    }
+    if (!decompile(&src))
+        return false;
+    // only the node paths and the symbols are needed, the properties are
+    // neither annotated nor resolved
+    m_tree.clear();
+    Chunk c;
+    QVector<int> nodes;
+    LineWindow lines(src);
+    int n = src.lineCount();
+    for (int inx=0; inx < n; ++inx) {
+        const LineInfo &info = lines.info(inx);
+        const QByteArray l = src.line(inx);
+        if (!adjustPath(&nodes, l, info) && !nodes.isEmpty() && m_tree.isSymbols(nodes.last()))
+            addSymbol(&c, l);
+    }
+    for (const auto &s : qAsConst(c.symbols)) {
+        // symbols of nodes that do not exist are never used
+        if (m_tree.find(s.first) >= 0)
+            symbols->insert(s.second, s.first);
+    }
+    log("read %d labels of base tree \"%s\"", symbols->size(), qPrintable(fn));
+    return true;
+}
+
+Annotate::ErrCodes Annotate::readAll(const QString &fn, QByteArray *data)
+{
+    data->clear();
+    if ((fn != "-") && !QFile::exists(fn))
+        return InputFileNotFound;
+    StreamInput in;
+    if (!in.open(fn))
+        return (in.status() == StreamUnsupported) ? CompressionNotSupported : InputFileOpenError;
+    *data = in.readAll();
+    if (in.status() == StreamDataError)
+        return CompressionError;
+    if ((in.status() != StreamOk) || data->isEmpty())
+        return InputFileReadError;
+    return noError;
+}
+
+Annotate::ErrCodes Annotate::outputError(const StreamOutput &out)
+{
+    return (out.status() == StreamDataError) ? CompressionError : OutputFileWriteError;
+}
+
 QString Annotate::errString(Annotate::ErrCodes err)
 {
     switch (err) {
@@ -141,8 +607,15 @@ QString Annotate::errString(Annotate::ErrCodes err)
     case InputFileNotFound: return QObject::tr("Input file not found");
     case InputFileOpenError: return QObject::tr("Cannot open input file for reading");
     case InputFileReadError: return QObject::tr("Error while reading input file");
+    case InputFormatError: return QObject::tr("Input file is not a valid device tree blob");
     case OutputFileCreationError: return QObject::tr("Cannot create output file");
     case OutputFileWriteError: return QObject::tr("Error while writing to output file");
+    case TemporaryFileError: return QObject::tr("Error while using a temporary file");
+    case CacheFileWriteError: return QObject::tr("Error while writing the cache file");
+    case XrefFileWriteError: return QObject::tr("Error while writing the cross-reference file");
+    case CompressionError: return QObject::tr("Compressed data is corrupt or truncated");
+    case CompressionNotSupported: return QObject::tr("Compression format is not supported by this build");
+    case StreamNotSupported: return QObject::tr("Incremental and overlay mode need an input and an output file");
     }
     return QObject::tr("Unknown error code <%1>").arg(static_cast<int>(err));
 }
@@ -152,6 +625,166 @@ QString Annotate::errString()
     return errString(m_lastError);
 }
 
+Annotate::ErrCodes Annotate::lastError() const
+{
+    return m_lastError;
+}
+
+void Annotate::setThreads(int threads)
+{
+    m_threads = (threads > 0) ? threads : QThread::idealThreadCount();
+    m_pool.setMaxThreadCount(m_threads);
+}
+
+void Annotate::setMaxMemory(qint64 bytes)
+{
+    m_maxMemory = qBound<qint64>(1024*1024, bytes, 1024*1024*1024);
+}
+
+void Annotate::setIncremental(bool on)
+{
+    m_incremental = on;
+    if (!on) {
+        m_cache.clear();
+        m_cacheFile.clear();
+    }
+}
+
+void Annotate::setCacheFile(const QString &fn)
+{
+    m_cacheFile = fn;
+    m_cacheLoaded = false;
+    m_incremental = !fn.isEmpty();
+}
+
+void Annotate::setXrefFile(const QString &fn)
+{
+    m_xrefFile = fn;
+}
+
+void Annotate::setPathReferences(bool on)
+{
+    m_pathReferences = on;
+}
+
+void Annotate::setBase(const QSharedPointer<const SymbolTable> &base)
+{
+    m_base = base;
+}
+
+void Annotate::endStage(Stage stage, QElapsedTimer *timer)
+{
+    m_stats.stageTime[stage] = timer->nsecsElapsed();
+    timer->start();
+    qint64 n = AllocCounter::count();
+    m_stats.allocations[stage] = n - m_allocCount;
+    m_allocCount = n;
+}
+
+void Annotate::addCounters(const Chunk &c)
+{
+    for (int i=0; i<PropertyTable::HandlerCount; ++i)
+        m_stats.properties[i] += c.stats.properties[i];
+    m_stats.numeric += c.stats.numeric;
+    m_stats.cacheLookups += c.stats.cacheLookups;
+    m_stats.cacheHits += c.stats.cacheHits;
+    m_stats.propertyAllocations += c.stats.propertyAllocations;
+    m_stats.nodeAllocations += c.stats.nodeAllocations;
+    m_stats.labels += c.stats.labels;
+    m_stats.resolved += c.stats.resolved;
+    m_stats.unresolved += c.stats.unresolved;
+    // in incremental mode the tree also holds nodes of earlier runs, the
+    // nodes of the file are counted by splitChunks()
+    if (!m_incremental)
+        m_stats.nodes = m_tree.size();
+}
+
+const char *Annotate::stageName(Stage stage)
+{
+    return stageNames[stage];
+}
+
+QString Annotate::statisticsText(const Statistics &s)
+{
+    qint64 total = 0;
+    for (auto t : s.stageTime)
+        total += t;
+    QString text;
+    for (int i=0; i<StageCount; ++i)
+        text += QString("%1 %2 ms\n").arg(stageNames[i], -22).arg(s.stageTime[i] / 1e6, 10, 'f', 2);
+    text += QString("%1 %2 ms\n").arg("total", -22).arg(total / 1e6, 10, 'f', 2);
+    text += QString("%1 %2 bytes, %3 lines, %4 nodes\n").arg("input", -22).arg(s.bytesIn).arg(s.lines).arg(s.nodes);
+    text += QString("%1 %2 bytes\n").arg("output", -22).arg(s.bytesOut);
+    if (total > 0) {
+        text += QString("%1 %2 MB/s, %3 lines/s\n").arg("throughput", -22)
+                .arg(s.bytesIn * 1e3 / total, 0, 'f', 1).arg(s.lines * 1e9 / total, 0, 'f', 0);
+    }
+    if (s.peakMemory > 0)
+        text += QString("%1 %2 MiB\n").arg("peak memory", -22).arg(s.peakMemory / 1048576.0, 0, 'f', 1);
+    if (AllocCounter::enabled()) {
+        qint64 allocs = 0;
+        for (auto n : s.allocations)
+            allocs += n;
+        text += QString("%1 %2, %3 while scanning, %4 per line, %5 in property lines, %6 in node lines\n").arg("heap allocations", -22).arg(allocs)
+                .arg(s.allocations[ScanStage]).arg((s.lines > 0) ? double(s.allocations[ScanStage]) / s.lines : 0.0, 0, 'f', 3)
+                .arg(s.propertyAllocations).arg(s.nodeAllocations);
+    }
+    for (int i=PropertyTable::SingleHandle; i<PropertyTable::HandlerCount; ++i)
+        text += QString("%1 %2\n").arg(handlerNames[i], -22).arg(s.properties[i]);
+    text += QString("%1 %2\n").arg("numeric", -22).arg(s.numeric);
+    text += QString("%1 %2\n").arg(handlerNames[PropertyTable::Plain], -22).arg(s.properties[PropertyTable::Plain] - s.numeric);
+    text += QString("%1 %2 resolved, %3 unresolved\n").arg("phandle references", -22).arg(s.resolved).arg(s.unresolved);
+    text += QString("%1 %2 of %3 lines, %4 %\n").arg("cached lines", -22).arg(s.cacheHits).arg(s.cacheLookups)
+            .arg((s.cacheLookups > 0) ? s.cacheHits * 100.0 / s.cacheLookups : 0.0, 0, 'f', 1);
+    text += QString("%1 %2").arg("labels", -22).arg(s.labels);
+    return text;
+}
+
+QJsonObject Annotate::statisticsJson(const Statistics &s)
+{
+    qint64 total = 0;
+    QJsonObject times;
+    for (int i=0; i<StageCount; ++i) {
+        times.insert(stageNames[i], s.stageTime[i] / 1e6);
+        total += s.stageTime[i];
+    }
+    times.insert("total", total / 1e6);
+    QJsonObject props;
+    for (int i=PropertyTable::SingleHandle; i<PropertyTable::HandlerCount; ++i)
+        props.insert(handlerKeys[i], s.properties[i]);
+    props.insert("numeric", s.numeric);
+    props.insert(handlerKeys[PropertyTable::Plain], s.properties[PropertyTable::Plain] - s.numeric);
+    QJsonObject handles;
+    handles.insert("resolved", s.resolved);
+    handles.insert("unresolved", s.unresolved);
+    QJsonObject o;
+    o.insert("timeMs", times);
+    o.insert("bytesIn", s.bytesIn);
+    o.insert("bytesOut", s.bytesOut);
+    o.insert("lines", s.lines);
+    o.insert("nodes", s.nodes);
+    o.insert("mbPerSecond", (total > 0) ? s.bytesIn * 1e3 / total : 0.0);
+    o.insert("linesPerSecond", (total > 0) ? s.lines * 1e9 / total : 0.0);
+    o.insert("peakMemory", s.peakMemory);
+    if (AllocCounter::enabled()) {
+        QJsonObject allocs;
+        for (int i=0; i<StageCount; ++i)
+            allocs.insert(stageNames[i], s.allocations[i]);
+        allocs.insert("propertyLines", s.propertyAllocations);
+        allocs.insert("nodeLines", s.nodeAllocations);
+        o.insert("allocations", allocs);
+    }
+    o.insert("properties", props);
+    o.insert("phandles", handles);
+    o.insert("labels", s.labels);
+    QJsonObject cache;
+    cache.insert("lookups", s.cacheLookups);
+    cache.insert("hits", s.cacheHits);
+    cache.insert("hitRate", (s.cacheLookups > 0) ? double(s.cacheHits) / s.cacheLookups : 0.0);
+    o.insert("cache", cache);
+    return o;
+}
+
 void Annotate::log(const char *fmt, ...)
 {
     if (!m_beQuiet) {
@@ -162,295 +795,1475 @@ void Annotate::log(const char *fmt, ...)
     }
 }
 
-Annotate::StringHash Annotate::createSymbolHash(QByteArrayList &ts)
+void Annotate::addSymbol(Chunk *c, const QByteArray &line)
 {
-    StringHash sym;
-    int n = ts.size();
-    // find start of symbols area
-    int inx = 0;
-    for (inx=0; inx < n; ++inx) {
-        QString l = ts[inx];
-        if (l.contains("__symbols__ {"))
-            break;
-    }
-    while (++inx < n) {
-        QString l = ts[inx].trimmed();
-        if (!l.isEmpty()) {
-            if (l.contains("};"))
-                break;
-            QStringList sl = l.split("=");
-            QString value = sl[0].trimmed();
-            QString key = sl[1].mid(2, sl[1].length()-4);
-            sym.insert(key, value);
-        }
-    }
-    return sym;
+    // label = "path"; split at the first '=' up to a second one, only the
+    // two entries of the table are allocated
+    int from = 0;
+    int to = line.size();
+    trimRange(line, &from, &to);
+    const char *d = line.constData();
+    const char *eq = static_cast<const char*>(memchr(d + from, '=', to - from));
+    if (!eq)
+        return;
+    int e = static_cast<int>(eq - d);
+    const char *next = static_cast<const char*>(memchr(eq + 1, '=', to - e - 1));
+    int n = (next ? static_cast<int>(next - d) : to) - e - 1;
+    // without ' "' and '";'
+    int keyLen = (n < 2) ? 0 : ((n >= 4) ? n - 4 : n - 2);
+    to = e;
+    trimRange(line, &from, &to);
+    c->symbols.append(qMakePair(QByteArray(eq + 3, keyLen), QByteArray(d + from, to - from)));
 }
 
-Annotate::StringHash Annotate::createHandleHash(QByteArrayList &ts)
+void Annotate::addHandle(Chunk *c, const QByteArray &line, const LineInfo &info)
 {
-    StringHash h;
-    QString path;
-    int n = ts.size();
-    for (int inx=0; inx < n; ++inx)  {
-        QString l = ts[inx].trimmed();
-        if (!adjustPath(&path, l)) {
-            // no path adjustments, maybe we find a handle?
-            if (l.contains("phandle")) {
-                QString handle = l.split("<")[1].trimmed().chopped(2);
-                h.insert(handle, path);
-            }
+    if (info.lt >= 0) {
+        // the text up to a second '<', if any, without ">;"
+        int from = info.lt + 1;
+        int to = line.indexOf('<', from);
+        if (to < 0)
+            to = line.size();
+        trimRange(line, &from, &to);
+        if (to - from >= 2) {
+            Cell h;
+            CellList::decode(line.constData() + from, to - from - 2, &h);
+            if (h.ok && (h.value != 0))
+                c->handles.append(qMakePair(h.value, c->nodes.isEmpty() ? -1 : c->nodes.last()));
         }
     }
-    return h;
 }
 
-bool Annotate::adjustPath(QString *path, const QString &line)
+bool Annotate::adjustPath(QVector<int> *nodes, const QByteArray &line, const LineInfo &info)
 {
     bool ret = false;
 
-    int i = line.indexOf('{');
+    int i = info.open;
     if (i > 0) {
-        // start of a new node with name
-        QString nn = line.left(i).trimmed();
-        if (nn=="/") {
-            *path = "/";
+        // start of a new node with name, trimmed by offsets, the node
+        // tree copies the name only for a new node
+        const char *d = line.constData();
+        int s = 0;
+        while ((s < i) && isspace(static_cast<uchar>(d[s])))
+            ++s;
+        while ((i > s) && isspace(static_cast<uchar>(d[i-1])))
+            --i;
+        if ((i - s == 1) && (d[s] == '/')) {
+            nodes->clear();
+            nodes->append(NodeTree::root);
         } else {
-            if (path->right(1)!="/") {
-                *path += '/' ;
+            if (nodes->isEmpty()) {
+                nodes->append(NodeTree::root);
+            } else if ((nodes->size() > 1) && m_tree.name(nodes->last()).isEmpty()) {
+                // a path ending with '/' gets no additional separator
+                nodes->removeLast();
             }
-            *path += nn;
+            int from = s;
+            const char *to;
+            while ((to = static_cast<const char*>(memchr(d + from, '/', static_cast<size_t>(i - from)))) != nullptr) {
+                nodes->append(m_tree.child(nodes->last(), d + from, static_cast<int>(to - d) - from));
+                from = static_cast<int>(to - d) + 1;
+            }
+            nodes->append(m_tree.child(nodes->last(), d + from, i - from));
         }
         ret = true;
     } else {
-        i = line.indexOf('}');
-        if (i>=0) {
+        if (info.close >= 0) {
             // end of node detected
-            QStringList sl = path->split("/");
-            sl.removeLast();
-            *path = sl.join('/');
-            if (path->isEmpty())
-                *path = "/";
+            if (nodes->size() > 1) {
+                nodes->removeLast();
+            } else {
+                nodes->clear();
+                nodes->append(NodeTree::root);
+            }
             ret = true;
         }
     }
     return ret;
 }
 
-const QString Annotate::getParameters(const QString &line)
+void Annotate::appendLeftOfParameters(Chunk *c, const QByteArray &l, const LineInfo &info)
+{
+    c->out.append(l.constData(), (info.eq < 0) ? l.size() : info.eq);
+    c->out += "= ";
+}
+
+void Annotate::appendHandle(Chunk *c, const Cell &h, PatchType type)
+{
+    // the symbols are usually at the end of the file, so the handle is
+    // written as it is and replaced later on in resolveChunk()
+    Patch p;
+    p.pos = c->out.size();
+    p.len = h.len;
+    p.type = type;
+    p.handle = h.value;
+    p.node = c->nodes.isEmpty() ? -1 : c->nodes.last();
+    c->patches.append(p);
+    c->out.append(h.text, h.len);
+}
+
+void Annotate::appendHandle(Chunk *c, const CellList &h, int inx, PatchType type)
+{
+    const Cell &cell = h[inx];
+    if ((cell.value == unresolvedHandle) && !m_fixups.isEmpty() && appendFixup(c, h.property(), inx))
+        return;
+    appendHandle(c, cell, type);
+}
+
+bool Annotate::appendFixup(Chunk *c, const QByteArray &property, int cell)
+{
+    // dtc lists the place of every reference to a label outside of the
+    // overlay as "path:property:byte offset"
+    if (c->nodes.isEmpty())
+        return false;
+    const QByteArray key = m_tree.path(c->nodes.last()) + ':' + property + ':' + QByteArray::number(4*cell);
+    const QByteArray label = m_fixups.value(key);
+    if (label.isEmpty() || !m_base->contains(label))
+        return false;
+    c->out += '&';
+    c->out += label;
+    ++c->stats.resolved;
+    // the node is not part of this tree, the index keeps its label
+    XrefIndex::Edge e;
+    e.from = c->nodes.last();
+    e.to = -1;
+    e.handle = unresolvedHandle;
+    e.property = property;
+    e.label = label;
+    c->fixups.append(e);
+    return true;
+}
+
+const QVector<int> *Annotate::localFixups(const Chunk *c, const char *name, int len) const
+{
+    if (c->nodes.isEmpty())
+        return nullptr;
+    auto it = m_localFixups.constFind(m_tree.path(c->nodes.last()) + ':' + QByteArray::fromRawData(name, len));
+    return (it != m_localFixups.constEnd()) ? &*it : nullptr;
+}
+
+void Annotate::appendLabel(Chunk *c)
 {
-    QString x = line.split("=")[1].trimmed();
-    return x.mid(1, x.length()-3);
+    Patch p;
+    p.pos = c->out.size();
+    p.len = 0;
+    p.type = LabelPatch;
+    p.handle = 0;
+    p.node = c->nodes.isEmpty() ? -1 : c->nodes.last();
+    c->patches.append(p);
 }
 
-const QString Annotate::handleToSymbol(const QString &h, const Annotate::StringHash &handles, const Annotate::StringHash &symbols)
+void Annotate::resolvePatch(Chunk *c, const Patch &p, QByteArray *out)
 {
-    QString hpath = handles.value(h);
-    if (hpath.isEmpty()) {
-        // handle not found
-        return h;
+    if (p.type == LabelPatch) {
+        if ((p.node >= 0) && (p.node < m_labels.size()) && !m_labels.at(p.node).isEmpty()) {
+            *out += m_labels.at(p.node);
+            *out += ": ";
+            ++c->stats.labels;
+        }
+        return;
     }
-    QString sym = symbols.value(hpath);
-    if (sym.isEmpty()) {
-        // symbol not found
-        return h;
+    const QByteArray &token = handleToken(p.handle);
+    if (!token.isEmpty()) {
+        ++c->stats.resolved;
+        *out += token;
+        return;
     }
-    return "&"+sym;
+    // handle or symbol not found, keep the text
+    ++c->stats.unresolved;
+    const char *s = c->out.constData() + p.pos;
+    if (p.type == HandleDecPatch) {
+        // unresolved handles are shown as decimal numbers
+        Cell x;
+        CellList::decode(s, p.len, &x);
+        hex2dec(out, x);
+    } else {
+        out->append(s, p.len);
+    }
+}
+
+const QByteArray &Annotate::handleToken(quint32 h) const
+{
+    static const QByteArray none;
+    if (h < static_cast<quint32>(m_handleTokens.size()))
+        return m_handleTokens[h];
+    auto it = m_sparseTokens.constFind(h);
+    return (it != m_sparseTokens.constEnd()) ? it.value() : none;
+}
+
+void Annotate::rkGPIO(QByteArray *out, const Cell &x)
+{
+    const char s[] = { 'R', 'K', '_', 'P', static_cast<char>(x.value/8+'A'), static_cast<char>(x.value%8+'0') };
+    out->append(s, sizeof(s));
+}
+
+void Annotate::gpioType(QByteArray *out, const Cell &x)
+{
+    if (x.value < sizeof(gpioTypes)/sizeof(gpioTypes[0]))
+        out->append(gpioTypes[x.value]);
+    else
+        out->append(x.text, x.len);
+}
+
+void Annotate::hex2dec(QByteArray *out, const Cell &x)
+{
+    if (x.prefixed)
+        CellList::appendNumber(out, x.value);
+    else
+        out->append(x.text, x.len);
+}
+
+void Annotate::interruptController(QByteArray *out, const Cell &x)
+{
+    // the text, not the number: dtc writes "0x00"
+    if ((x.len == 3) && !memcmp(x.text, "0x0", 3))
+        out->append("GIC_SPI");
+    else if ((x.len == 3) && !memcmp(x.text, "0x1", 3))
+        out->append("GIC_PPI");
+    else
+        out->append(x.text, x.len);
+}
+
+void Annotate::irqType(QByteArray *out, const Cell &x)
+{
+    const char *t = (x.value < sizeof(irqTypes)/sizeof(irqTypes[0])) ? irqTypes[x.value] : nullptr;
+    if (t)
+        out->append(t);
+    else
+        out->append(x.text, x.len);
+}
+
+void Annotate::writeHeader(QByteArray *out)
+{
+    *out += "/*\n";
+    *out += " *  created by " + qApp->applicationName().toUtf8() + " V" + qApp->applicationVersion().toUtf8() + "\n";
+    *out += " *  " + QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss").toUtf8() + "\n";
+    *out += " */\n";
 }
 
-const QString Annotate::rkGPIO(const QString &x)
+QVector<Annotate::Chunk> Annotate::splitChunks(const SourceBuffer &src)
 {
-    uint n = x.toUInt(nullptr, 0);
-    return QString("RK_P%1%2").arg(static_cast<char>(n/8+'A')).arg(n%8);
+    QVector<Chunk> chunks;
+    SplitState s;
+    beginSplit(&s, src.lineCount());
+    splitLines(src, src.lineCount(), &s, &chunks);
+    if (!endSplit(src, &s, &chunks))
+        return splitChunks(src);
+    return chunks;
 }
 
-const QString Annotate::gpioType(const QString &x)
+void Annotate::beginSplit(SplitState *s, int lines)
 {
-    uint n = x.toUInt(nullptr, 0);
-    switch(n) {
-    case 0: return "GPIO_ACTIVE_HIGH";
-    case 1: return "GPIO_ACTIVE_LOW";
-    case 2: return "GPIO_OPEN_SOURCE";
-    case 3: return "GPIO_OPEN_DRAIN";
+    s->c.first = 0;
+    s->c.nodes.clear();
+    s->c.stats = Statistics();
+    s->c.cached = false;
+    // the node ids of the last run are kept as long as there are cached
+    // chunks that refer to them
+    if (!m_incremental || m_cache.isEmpty())
+        m_tree.clear();
+    // nodes of this file, the tree also holds those of earlier runs
+    s->live.clear();
+    s->liveNodes = 0;
+    s->nodes.clear();
+    s->next = 0;
+    // in incremental mode every top-level node is a chunk of its own,
+    // so an edit does not move the other chunks
+    s->cut = (m_threads > 1) || m_incremental;
+    s->minLines = m_incremental ? 1 : lines / (4*m_threads) + 1;
+    s->maxDepth = m_incremental ? 1 : 2;
+}
+
+void Annotate::splitLines(const SourceBuffer &src, int to, SplitState *s, QVector<Chunk> *chunks)
+{
+    // prefix scan of the node path: a chunk may start at every node
+    // below the root or below one of its children, the path at that
+    // line is all the chunk needs to know about the lines before it.
+    // All nodes are created here, the chunks only look them up
+    if (!s->cut) {
+        s->next = to;
+        return;
+    }
+    LineWindow lines(src);
+    Chunk &c = s->c;
+    QVector<int> &nodes = s->nodes;
+    for (int inx=s->next; inx < to; ++inx) {
+        const LineInfo &info = lines.info(inx);
+        QByteArray l = src.line(inx);
+        if (isHandleDefinition(l, info))
+            continue;
+        if ((inx - c.first >= s->minLines) && (nodes.size() >= 1) && (nodes.size() <= s->maxDepth) && (info.open > 0)) {
+            c.last = inx;
+            if (m_incremental)
+                hashChunk(src, &c);
+            chunks->append(c);
+            c.first = inx;
+            c.nodes = nodes;
+        }
+        if (adjustPath(&nodes, l, info) && (info.open > 0)) {
+            // the parents of a known node are known, too
+            s->live.resize(m_tree.size());
+            for (int i=nodes.size()-1; (i >= 0) && !s->live.at(nodes.at(i)); --i) {
+                s->live[nodes.at(i)] = true;
+                ++s->liveNodes;
+            }
+        }
     }
-    return(x);
+    s->next = to;
 }
 
-const QString Annotate::hex2dec(const QString &x)
+bool Annotate::endSplit(const SourceBuffer &src, SplitState *s, QVector<Chunk> *chunks)
 {
-    QString s(x);
-    if (x.contains("0x")) {
-        s = QString::number(x.toUInt(nullptr, 0));
+    s->c.last = src.lineCount();
+    if (m_incremental)
+        hashChunk(src, &s->c);
+    chunks->append(s->c);
+    if (m_incremental) {
+        m_stats.nodes = s->liveNodes;
+        int dead = m_tree.size() - s->liveNodes;
+        if (!m_cache.isEmpty() && (dead > s->liveNodes)) {
+            // the nodes removed or renamed since the cache was built
+            // outnumber those of the file, so they are dropped together
+            // with the cache and all nodes are annotated again
+            log("%d nodes of earlier runs no longer exist, dropping the cache", dead);
+            m_cache.clear();
+            chunks->clear();
+            return false;
+        }
     }
-    return s;
+    return true;
 }
 
-const QString Annotate::interruptController(const QString &x)
+void Annotate::hashChunk(const SourceBuffer &src, Chunk *c)
 {
-    if (x=="0x0") return "GIC_SPI";
-    if (x=="0x1") return "GIC_PPI";
-    return x;
+    // a chunk is unchanged if its lines and its place in the tree are
+    QCryptographicHash h(QCryptographicHash::Md5);
+    h.addData(reinterpret_cast<const char*>(c->nodes.constData()), c->nodes.size() * static_cast<int>(sizeof(int)));
+    h.addData(src.data() + src.lineOffset(c->first), src.lineOffset(c->last) - src.lineOffset(c->first));
+    c->hash = h.result();
 }
 
-const QString Annotate::irqType(const QString &x)
+void Annotate::scanChunk(const SourceBuffer &src, Chunk *c)
 {
-    uint n = x.toUInt(nullptr, 0);
-    switch(n) {
-    case 0: return "IRQ_TYPE_NONE";
-    case 1: return "IRQ_TYPE_EDGE_RISING";
-    case 2: return "IRQ_TYPE_EDGE_FALLING";
-    case 3: return "IRQ_TYPE_EDGE_BOTH";
-    case 4: return "IRQ_TYPE_LEVEL_HIGH";
-    case 8: return "IRQ_TYPE_LEVEL_LOW";
+    // the output is a little larger than the input
+    int size = src.lineOffset(c->last) - src.lineOffset(c->first);
+    c->out.reserve(size + size/4);
+    // one line object for all lines, the temporaries of a node come from
+    // the arena, which is reset at every node, repeated lines from the cache
+    // of the thread, which is kept for all chunks and files
+    ScanLease lease(this);
+    QByteArray line;
+    const char *d = src.data();
+    // the path at the start is part of the hash and kept in the cache, the
+    // path of the lines has room for deep nodes
+    const QVector<int> start = c->nodes;
+    c->nodes.reserve(start.size() + 64);
+    LineWindow lines(src, qMin(c->last - c->first, 65536));
+    for (int inx=c->first; inx < c->last; ++inx) {
+        const LineInfo &info = lines.info(inx);
+        line.setRawData(d + info.offset, static_cast<uint>(info.length));
+        scanLine(c, line, info, lease.state());
     }
-    return(x);
+    c->nodes = start;
 }
 
-bool Annotate::writeOutput(const QString &fnOut, ByteArrayList &tsIn, const StringHash &symbols, const StringHash &handles)
+void Annotate::mergeTables(const QVector<Chunk> &chunks)
 {
-    QFile f(fnOut);
-    if (!f.open(QFile::Truncate | QIODevice::WriteOnly)) {
-        m_lastError = OutputFileCreationError;
+    // in order of the chunks, so later definitions win as in a sequential scan
+    m_labels = QVector<QByteArray>(m_tree.size());
+    quint32 maxHandle = 0;
+    for (const auto &c : chunks) {
+        for (const auto &s : c.symbols) {
+            // symbols of nodes that do not exist are never used
+            int node = m_tree.find(s.first);
+            if (node >= 0)
+                m_labels[node] = s.second;
+        }
+        for (const auto &h : c.handles) {
+            if ((h.first <= maxDenseHandle) && (h.first > maxHandle))
+                maxHandle = h.first;
+        }
+    }
+    // phandles are numbered from 1 by dtc, so a plain vector indexed by
+    // the phandle holds the complete "&label" token
+    m_handleTokens = QVector<QByteArray>(maxHandle + 1);
+    m_sparseTokens.clear();
+    for (const auto &c : chunks) {
+        for (const auto &h : c.handles) {
+            QByteArray token;
+            if ((h.second >= 0) && !m_labels[h.second].isEmpty())
+                token = "&" + m_labels[h.second];
+            else if ((h.second >= 0) && m_pathReferences)
+                token = "&{" + m_tree.path(h.second) + "}";
+            if (h.first <= maxHandle)
+                m_handleTokens[h.first] = token;
+            else
+                m_sparseTokens.insert(h.first, token);
+        }
+    }
+}
+
+void Annotate::resolveChunk(Chunk *c)
+{
+    // insert the resolved symbols and handles
+    QByteArray out;
+    out.reserve(c->out.size() + c->patches.size()*16);
+    int pos = 0;
+    for (const auto &p : qAsConst(c->patches)) {
+        out.append(c->out.constData() + pos, p.pos - pos);
+        resolvePatch(c, p, &out);
+        pos = p.pos + p.len;
+    }
+    out.append(c->out.constData() + pos, c->out.size() - pos);
+    c->out = out;
+    c->patches.clear();
+}
+
+bool Annotate::emitChunks(QVector<Chunk> *chunks, const std::function<bool(const QByteArray&)> &write)
+{
+    // the chunks are resolved straight into blocks of the output, no
+    // resolved copy of a chunk is built and a chunk is dropped as soon as
+    // it is resolved
+    QByteArray block;
+    block.reserve(outputBlockSize + outputBlockSize/4);
+    for (auto &c : *chunks) {
+        int pos = 0;
+        for (const auto &p : qAsConst(c.patches)) {
+            block.append(c.out.constData() + pos, p.pos - pos);
+            resolvePatch(&c, p, &block);
+            pos = p.pos + p.len;
+            if (block.size() >= outputBlockSize) {
+                if (!write(block))
+                    return false;
+                m_stats.bytesOut += block.size();
+                block.resize(0);
+            }
+        }
+        block.append(c.out.constData() + pos, c.out.size() - pos);
+        addCounters(c);
+        c.out = QByteArray();
+        c.patches = QVector<Patch>();
+    }
+    if (!write(block))
         return false;
+    m_stats.bytesOut += block.size();
+    return true;
+}
+
+void Annotate::reuseChunks(QVector<Chunk> *chunks)
+{
+    int reused = 0;
+    for (auto &c : *chunks) {
+        if (reuseChunk(&c))
+            ++reused;
     }
-    QTextStream tsOut(&f);
-    log("writing to \"%s\"\n", qPrintable(fnOut));
-    tsOut << "/*\n";
-    tsOut << " *  created by " << qApp->applicationName() << " V" << qApp->applicationVersion() << "\n";
-    tsOut << " *  " << QDateTime::currentDateTime().toString("yyyy-MM-dd hh:mm:ss") << "\n";
-    tsOut << " */\n";
-    QString path;
-    int n = tsIn.size();
-    for (int inx=0; inx < n; ++inx)  {
-        QString l = tsIn[inx];
-        if (l.contains("phandle = <0x")) {
-            // remove phandle lines from output file
+    log("%d of %d top-level nodes unchanged", reused, chunks->size());
+}
+
+bool Annotate::reuseChunk(Chunk *c)
+{
+    auto it = m_cache.constFind(c->hash);
+    if (it == m_cache.constEnd())
+        return false;
+    // same lines at the same place in the tree, the node ids of the
+    // last run are still valid
+    int first = c->first;
+    int last = c->last;
+    *c = it->scanned;
+    c->first = first;
+    c->last = last;
+    c->cached = true;
+    return true;
+}
+
+void Annotate::resolveIncremental(Chunk *c)
+{
+    // the output of the last run is valid as long as all labels and
+    // phandles it was resolved with are the same
+    const char sep = 0;
+    QCryptographicHash h(QCryptographicHash::Md5);
+    for (const auto &p : qAsConst(c->patches)) {
+        h.addData((p.type == LabelPatch) ? m_labels.value(p.node) : handleToken(p.handle));
+        h.addData(&sep, 1);
+    }
+    c->tokens = h.result();
+    auto it = m_cache.constFind(c->hash);
+    if ((it != m_cache.constEnd()) && (it->tokens == c->tokens)) {
+        c->out = it->out;
+        c->stats = it->stats;
+        c->patches.clear();
+        return;
+    }
+    resolveChunk(c);
+}
+
+void Annotate::updateCache(const QVector<Chunk> &chunks, QHash<QByteArray, CacheEntry> *next)
+{
+    // only the chunks of this run are kept
+    for (const auto &c : chunks) {
+        CacheEntry &e = (*next)[c.hash];
+        e.tokens = c.tokens;
+        e.out = c.out;
+        e.stats = c.stats;
+    }
+    m_cache.swap(*next);
+}
+
+bool Annotate::loadCache()
+{
+    QFile f(m_cacheFile);
+    if (!f.open(QIODevice::ReadOnly))
+        return false;
+    QDataStream ds(&f);
+    ds.setVersion(QDataStream::Qt_5_12);
+    quint32 magic;
+    qint32 version, patchSize, statsSize, nodes;
+    QString appVersion;
+    ds >> magic >> version >> appVersion >> patchSize >> statsSize >> nodes;
+    if ((ds.status() != QDataStream::Ok) || (magic != cacheMagic) || (version != cacheVersion)
+            || (appVersion != qApp->applicationVersion()) || (patchSize != sizeof(Patch))
+            || (statsSize != sizeof(Statistics)) || (nodes < 1))
+        return false;
+    // the nodes are stored in order of their ids, so they get the same ids again
+    m_tree.clear();
+    for (int i=1; i<nodes; ++i) {
+        qint32 parent;
+        QByteArray name;
+        ds >> parent >> name;
+        if ((ds.status() != QDataStream::Ok) || (parent < 0) || (parent >= i) || (m_tree.child(parent, name) != i))
+            return false;
+    }
+    qint32 count;
+    ds >> count;
+    m_cache.clear();
+    for (int i=0; (i<count) && (ds.status() == QDataStream::Ok); ++i) {
+        CacheEntry e;
+        Chunk &c = e.scanned;
+        qint32 patches;
+        ds >> c.hash >> c.nodes >> c.out >> patches;
+        if ((ds.status() != QDataStream::Ok) || (patches < 0))
+            return false;
+        // a truncated file must not make us allocate the count it claims
+        if (patches > f.bytesAvailable() / patchSize)
+            return false;
+        c.patches.resize(patches);
+        bool valid = (ds.readRawData(reinterpret_cast<char*>(c.patches.data()), patches * patchSize) == patches * patchSize);
+        ds >> c.symbols >> c.handles;
+        valid = valid && (ds.readRawData(reinterpret_cast<char*>(&c.stats), statsSize) == statsSize);
+        ds >> e.tokens >> e.out;
+        valid = valid && (ds.readRawData(reinterpret_cast<char*>(&e.stats), statsSize) == statsSize);
+        c.first = 0;
+        c.last = 0;
+        c.cached = false;
+        // never trust node ids, positions and counters of a file
+        for (int n : qAsConst(c.nodes))
+            valid = valid && (n >= 0) && (n < nodes);
+        for (const auto &h : qAsConst(c.handles))
+            valid = valid && (h.second >= -1) && (h.second < nodes);
+        int pos = 0;
+        for (const auto &p : qAsConst(c.patches)) {
+            valid = valid && (p.type >= LabelPatch) && (p.type <= HandleDecPatch)
+                    && (p.pos >= pos) && (p.len >= 0) && (p.len <= c.out.size() - p.pos)
+                    && (p.node >= -1) && (p.node < nodes);
+            pos = p.pos + p.len;
+        }
+        valid = valid && isValid(c.stats) && isValid(e.stats);
+        if (!valid)
+            return false;
+        m_cache.insert(c.hash, e);
+    }
+    log("loaded %d cached top-level nodes from \"%s\"", m_cache.size(), qPrintable(m_cacheFile));
+    return ds.status() == QDataStream::Ok;
+}
+
+bool Annotate::saveCache()
+{
+    QSaveFile f(m_cacheFile);
+    if (!f.open(QIODevice::WriteOnly))
+        return false;
+    QDataStream ds(&f);
+    ds.setVersion(QDataStream::Qt_5_12);
+    // patches and counters are stored as they are, the sizes and the
+    // version reject files of other builds
+    ds << cacheMagic << cacheVersion << qApp->applicationVersion()
+       << static_cast<qint32>(sizeof(Patch)) << static_cast<qint32>(sizeof(Statistics))
+       << static_cast<qint32>(m_tree.size());
+    for (int i=1; i<m_tree.size(); ++i)
+        ds << static_cast<qint32>(m_tree.parent(i)) << m_tree.name(i);
+    ds << static_cast<qint32>(m_cache.size());
+    for (auto it = m_cache.constBegin(); it != m_cache.constEnd(); ++it) {
+        const Chunk &c = it->scanned;
+        ds << c.hash << c.nodes << c.out << static_cast<qint32>(c.patches.size());
+        ds.writeRawData(reinterpret_cast<const char*>(c.patches.constData()), c.patches.size() * static_cast<int>(sizeof(Patch)));
+        ds << c.symbols << c.handles;
+        ds.writeRawData(reinterpret_cast<const char*>(&c.stats), sizeof(Statistics));
+        ds << it->tokens << it->out;
+        ds.writeRawData(reinterpret_cast<const char*>(&it->stats), sizeof(Statistics));
+    }
+    return (ds.status() == QDataStream::Ok) && f.commit();
+}
+
+void Annotate::collectReferences(const Chunk &c, int from, int to)
+{
+    // the property of a phandle is the text left of the '=' in its line,
+    // the patches are in order of their position
+    int lineEnd = -1;
+    QByteArray property;
+    to = qMin(to, c.patches.size());
+    for (int i=from; i<to; ++i) {
+        const Patch &p = c.patches.at(i);
+        if (p.type == LabelPatch)
             continue;
+        if (p.pos > lineEnd) {
+            int start = (p.pos > 0) ? c.out.lastIndexOf('\n', p.pos - 1) + 1 : 0;
+            lineEnd = c.out.indexOf('\n', p.pos);
+            if (lineEnd < 0)
+                lineEnd = c.out.size();
+            int eq = c.out.indexOf('=', start);
+            property = ((eq >= 0) && (eq < p.pos)) ? c.out.mid(start, eq - start).trimmed() : QByteArray();
+        }
+        XrefIndex::Edge e;
+        e.from = p.node;
+        e.to = -1;
+        e.handle = p.handle;
+        e.property = property;
+        m_edges.append(e);
+    }
+    m_edges += c.fixups;
+}
+
+bool Annotate::writeXref(const QVector<Chunk> &chunks)
+{
+    // later phandle definitions win as in mergeTables()
+    QVector<quint32> handles(m_tree.size());
+    QHash<quint32, int> nodes;
+    for (const auto &c : chunks) {
+        for (const auto &h : c.handles) {
+            if ((h.second >= 0) && (h.second < handles.size()))
+                handles[h.second] = h.first;
+            nodes.insert(h.first, h.second);
+        }
+    }
+    for (auto &e : m_edges)
+        e.to = e.label.isEmpty() ? nodes.value(e.handle, -1) : -1;
+    QSaveFile f(m_xrefFile);
+    if (!f.open(QIODevice::WriteOnly))
+        return false;
+    QByteArray data = XrefIndex::build(m_tree, m_labels, handles, m_edges);
+    log("writing %d phandle references to \"%s\"", m_edges.size(), qPrintable(m_xrefFile));
+    m_edges.clear();
+    return (f.write(data) == data.size()) && f.commit();
+}
+
+void Annotate::runChunks(QVector<Chunk> *chunks, const std::function<void(Chunk*)> &f)
+{
+    if (chunks->size() == 1) {
+        f(chunks->data());
+        return;
+    }
+    // the pool lives as long as the instance, so its threads are reused
+    Chunk *c = chunks->data();
+    for (int i=0; i<chunks->size(); ++i) {
+        Chunk *chunk = &c[i];
+        m_pool.start([&f, chunk]() { f(chunk); });
+    }
+    m_pool.waitForDone();
+}
+
+Annotate::ScanState *Annotate::acquireState()
+{
+    ScanState *state = nullptr;
+    {
+        QMutexLocker lock(&m_statesMutex);
+        if (!m_states.isEmpty())
+            state = m_states.takeLast();
+    }
+    if (!state) {
+        // the cache is set up with the first property line
+        state = new ScanState;
+        state->overlay = m_overlay;
+    }
+    if (state->overlay != m_overlay) {
+        // "target" is a phandle in overlays only
+        for (auto &s : state->cache) {
+            s.hash = 0;
+            s.valid = false;
+        }
+        state->overlay = m_overlay;
+    }
+    state->arena.reset();
+    return state;
+}
+
+void Annotate::releaseState(ScanState *state)
+{
+    QMutexLocker lock(&m_statesMutex);
+    m_states.append(state);
+}
+
+void Annotate::scanLine(Chunk *c, const QByteArray &l, const LineInfo &info, ScanState *state)
+{
+    if (c->out.capacity() - c->out.size() < 4*l.size() + 64) {
+        // the output buffer grows by doubling, a line never takes more
+        // than a few times its input size
+        c->out.reserve(2*c->out.capacity() + 4*l.size() + 64);
+    }
+    if (c->patches.capacity() - c->patches.size() < l.size()/2 + 2) {
+        // the same for the patches, at most one per cell and a label
+        c->patches.reserve(2*c->patches.capacity() + l.size()/2 + 2);
+    }
+    if (isHandleDefinition(l, info)) {
+        // remember node of phandle, remove phandle lines from output file
+        addHandle(c, l, info);
+        return;
+    }
+    // a node line allocates only for a node that is new to the tree
+    const qint64 nodeAllocs = AllocCounter::threadCount();
+    const int treeSize = m_tree.size();
+    if (adjustPath(&c->nodes, l, info)) {
+        // nothing of the last node is needed any more
+        state->arena.reset();
+        // add symbol to path
+        if (info.close < 0) {
+            int i = l.lastIndexOf('\t')+1;
+            c->out.append(l.constData(), i);
+            appendLabel(c);
+            c->out.append(l.constData() + i, l.size() - i);
+        } else {
+            c->out += l;
+        }
+        c->out += '\n';
+        if (m_tree.size() == treeSize)
+            c->stats.nodeAllocations += AllocCounter::threadCount() - nodeAllocs;
+        return;
+    }
+    // no path adjustments, maybe we can adjust handles or values
+    if (!c->nodes.isEmpty() && m_tree.isSymbols(c->nodes.last())) {
+        // collect contents of "__symbols__" region, but do not output it
+        addSymbol(c, l);
+        return;
+    }
+    if ((info.lt >= 0) && l.contains("phandle")) {
+        // other phandle notations
+        addHandle(c, l, info);
+    }
+    if (state->cache.isEmpty()) {
+        // one block for all cache slots, only the pages of the slots in
+        // use are ever touched, and the first block of the arena
+        const int size = maxCachedPatches * static_cast<int>(sizeof(Patch)) + maxCachedLine + maxCachedOut;
+        state->storage = QByteArray(cacheSlots * size, Qt::Uninitialized);
+        state->cache.resize(cacheSlots);
+        char *p = state->storage.data();
+        for (auto &s : state->cache) {
+            s.hash = 0;
+            s.valid = false;
+            s.patches = reinterpret_cast<Patch*>(p);
+            s.line = p + maxCachedPatches * sizeof(Patch);
+            s.out = s.line + maxCachedLine;
+            p += size;
+        }
+        state->arena.allocate(1);
+        state->arena.reset();
+    }
+    // from now on everything a property line needs is in the arena, the
+    // cache or the reserved output, only the fixups of overlays are
+    // looked up by a key built on the heap
+    const qint64 allocs = AllocCounter::threadCount();
+    int eq = info.eq;
+    int nameFrom = 0;
+    int nameTo = (eq < 0) ? l.size() : eq;
+    trimRange(l, &nameFrom, &nameTo);
+    const char *name = l.constData() + nameFrom;
+    int nameLen = nameTo - nameFrom;
+    PropertyTable::Handler handler = PropertyTable::lookup(name, nameLen);
+    if (m_overlay && (handler == PropertyTable::Plain) && (nameLen == 6) && !memcmp(name, "target", 6)) {
+        // the node a fragment of an overlay is applied to
+        handler = PropertyTable::SingleHandle;
+    }
+    ++c->stats.properties[handler];
+    bool numeric = false;
+    if ((handler == PropertyTable::Plain) && (eq >= 0)) {
+        // regular parameters are converted to decimal numbers, strings
+        // and registers are not
+        int v = eq + 1;
+        while ((v < l.size()) && isspace(static_cast<uchar>(l.at(v))))
+            ++v;
+        numeric = ((v >= l.size()) || (l.at(v) != '"')) && !containsText(name, nameLen, "reg");
+    }
+    // the same line gives the same text and patches, as long as no
+    // fixups of an overlay depend on the node. A line is kept when it is
+    // seen the second time, so lines that never repeat cost no copies
+    CacheSlot *slot = nullptr;
+    int outStart = c->out.size();
+    int patchStart = c->patches.size();
+    if (((handler != PropertyTable::Plain) || numeric) && (l.size() <= maxCachedLine)
+            && m_fixups.isEmpty() && m_localFixups.isEmpty()) {
+        uint hash = qHash(l);
+        slot = &state->cache[hash & (cacheSlots - 1)];
+        ++c->stats.cacheLookups;
+        if (slot->valid && (slot->hash == hash) && (slot->lineLen == l.size()) && !memcmp(slot->line, l.constData(), l.size())) {
+            ++c->stats.cacheHits;
+            if (numeric)
+                ++c->stats.numeric;
+            c->out.append(slot->out, slot->outLen);
+            int node = c->nodes.isEmpty() ? -1 : c->nodes.last();
+            for (int i=0; i<slot->patchCount; ++i) {
+                Patch p = slot->patches[i];
+                p.pos += outStart;
+                p.node = node;
+                c->patches.append(p);
+            }
+            c->out += '\n';
+            c->stats.propertyAllocations += AllocCounter::threadCount() - allocs;
+            return;
+        }
+        if ((slot->hash != hash) || slot->valid) {
+            // first time seen
+            slot->hash = hash;
+            slot->valid = false;
+            slot = nullptr;
+        }
+    }
+    switch (handler) {
+    case PropertyTable::SingleHandle: {
+        // only a simple phandle exchange is required
+        int len;
+        const char *h = l.constData() + CellList::parameters(l, info, &len);
+        Cell cell;
+        CellList::decode(h, len, &cell);
+        const char *from = l.constData();
+        const char *end = from + l.size();
+        while (len > 0) {
+            const char *i = std::search(from, end, h, h + len);
+            if (i == end)
+                break;
+            c->out.append(from, static_cast<int>(i - from));
+            if ((cell.value != unresolvedHandle) || m_fixups.isEmpty() || !appendFixup(c, QByteArray(name, nameLen), 0))
+                appendHandle(c, cell);
+            from = i + len;
         }
-        if (adjustPath(&path, l)) {
-            // add symbol to path
-            if (!l.contains("}")) {
-                QString sym = symbols.value(path);
-                if (!sym.isEmpty()) {
-                    l.insert(l.lastIndexOf('\t')+1, sym + ": ");
+        c->out.append(from, static_cast<int>(end - from));
+        break;
+    }
+    case PropertyTable::FirstHandleGpio: {
+        // only very first parameter is a phandle, the gpio flags are not emitted
+        const CellList h(l, info, &state->arena);
+        appendLeftOfParameters(c, l, info);
+        c->out += '<';
+        appendHandle(c, h, 0);
+        c->out += ' ';
+        rkGPIO(&c->out, h[1]);
+        c->out += ">;";
+        break;
+    }
+    case PropertyTable::FirstHandle: {
+        // only very first parameter is a phandle
+        const CellList h(l, info, &state->arena);
+        appendLeftOfParameters(c, l, info);
+        c->out += '<';
+        appendHandle(c, h, 0);
+        // join all parameters after converting from hex to dec
+        for (int i=1; i< h.size(); ++i) {
+            c->out += ' ';
+            hex2dec(&c->out, h[i]);
+        }
+        c->out += ">;";
+        break;
+    }
+    case PropertyTable::ListHandle: {
+        // all parameters are phandles
+        const CellList h(l, info, &state->arena);
+        appendLeftOfParameters(c, l, info);
+        for (int i=0; i<h.size(); ++i) {
+            c->out += '<';
+            appendHandle(c, h, i);
+            c->out += endOfCells(i==h.size()-1);
+        }
+        break;
+    }
+    case PropertyTable::Clocks: {
+        const CellList h(l, info, &state->arena);
+        appendLeftOfParameters(c, l, info);
+        int n = h.size();
+        if (n==1) {
+            c->out += '<';
+            appendHandle(c, h, 0);
+            c->out += ">;";
+        } else {
+            for (int i=0; i<n; i+=2) {
+                c->out += '<';
+                appendHandle(c, h, i);
+                c->out += ' ';
+                hex2dec(&c->out, h[i+1]);
+                c->out += endOfCells(i==n-2);
+            }
+        }
+        break;
+    }
+    case PropertyTable::RockchipPins: {
+        const CellList h(l, info, &state->arena);
+        appendLeftOfParameters(c, l, info);
+        c->out += "<RK_GPIO";
+        if (h[0].ok && (h[0].value <= INT_MAX))
+            CellList::appendNumber(&c->out, h[0].value);
+        else
+            c->out += QByteArray::number(QByteArray::fromRawData(h[0].text, h[0].len).toInt(nullptr, 0));
+        c->out += ' ';
+        rkGPIO(&c->out, h[1]);
+        if (h[2].value==0) {
+            c->out += " RK_FUNC_GPIO";
+        } else {
+            c->out += " RK_FUNC_";
+            CellList::appendNumber(&c->out, h[2].value);
+        }
+        c->out += ' ';
+        appendHandle(c, h, 3);
+        c->out += ">;";
+        break;
+    }
+    case PropertyTable::RockchipPowerCtrl: {
+        const CellList h(l, info, &state->arena);
+        appendLeftOfParameters(c, l, info);
+        int n = h.size();
+        for (int i=0; i<n; i+=3) {
+            c->out += '<';
+            appendHandle(c, h, i);
+            c->out += ' ';
+            rkGPIO(&c->out, h[i+1]);
+            c->out += ' ';
+            gpioType(&c->out, h[i+2]);
+            c->out += endOfCells(i==n-3);
+        }
+        break;
+    }
+    case PropertyTable::Interrupts: {
+        const CellList h(l, info, &state->arena);
+        int n = h.size();
+        appendLeftOfParameters(c, l, info);
+        if (n%4==0) {
+            for (int i=0; i<n; i+=4) {
+                c->out += '<';
+                interruptController(&c->out, h[i]);
+                c->out += ' ';
+                hex2dec(&c->out, h[i+1]);
+                c->out += ' ';
+                irqType(&c->out, h[i+2]);
+                c->out += ' ';
+                appendHandle(c, h, i+3, HandleDecPatch);
+                c->out += endOfCells(i==n-4);
+            }
+        } else {
+            for (int i=0; i<n; i+=2) {
+                c->out += '<';
+                rkGPIO(&c->out, h[i]);
+                c->out += ' ';
+                hex2dec(&c->out, h[i+1]);
+                c->out += endOfCells(i==n-2);
+            }
+        }
+        break;
+    }
+    case PropertyTable::InterruptMap: {
+        const CellList h(l, info, &state->arena);
+        int n = h.size();
+        appendLeftOfParameters(c, l, info);
+        if (n%6==0) {
+            for (int i=0; i<n; i+=6) {
+                c->out += '<';
+                for (int j=0; j<4; ++j) {
+                    hex2dec(&c->out, h[i+j]);
+                    c->out += ' ';
                 }
+                appendHandle(c, h, i+4);
+                c->out += ' ';
+                hex2dec(&c->out, h[i+5]);
+                c->out += endOfCells(i==n-6);
             }
         } else {
-            // no path adjustments, maybe we can adjust handles or values
-            if (path.contains("__symbols__")) {
-                // remove contents of "__symbols__" region
+            for (int i=0; i<n; i+=2) {
+                c->out += '<';
+                rkGPIO(&c->out, h[i]);
+                c->out += ' ';
+                hex2dec(&c->out, h[i+1]);
+                c->out += endOfCells(i==n-2);
+            }
+        }
+        break;
+    }
+    case PropertyTable::Plain: {
+        // cells of an overlay listed in "__local_fixups__" are phandles
+        const QVector<int> *local = (m_localFixups.isEmpty() || (info.lt < 0)) ? nullptr : localFixups(c, name, nameLen);
+        if (numeric || local) {
+            // numeric parameter list
+            if (numeric)
+                ++c->stats.numeric;
+            const CellList h(l, info, &state->arena);
+            appendLeftOfParameters(c, l, info);
+            c->out += '<';
+            for (int i=0; i<h.size(); ++i) {
+                if (local && local->contains(4*i))
+                    appendHandle(c, h[i], numeric ? HandleDecPatch : HandlePatch);
+                else if (numeric)
+                    hex2dec(&c->out, h[i]);
+                else
+                    c->out.append(h[i].text, h[i].len);
+                c->out += ' ';
+            }
+            c->out.chop(1);
+            c->out += ">;";
+        } else {
+            // string parameters or anything else: nothing to do
+            c->out += l;
+        }
+        break;
+    }
+    }
+    int outLen = c->out.size() - outStart;
+    int patchCount = c->patches.size() - patchStart;
+    if (slot && (outLen <= maxCachedOut) && (patchCount <= maxCachedPatches)) {
+        // keep the annotated line, the patches relative to its start
+        slot->valid = true;
+        slot->lineLen = l.size();
+        memcpy(slot->line, l.constData(), static_cast<size_t>(l.size()));
+        slot->outLen = outLen;
+        memcpy(slot->out, c->out.constData() + outStart, static_cast<size_t>(outLen));
+        slot->patchCount = patchCount;
+        for (int i=0; i<patchCount; ++i) {
+            slot->patches[i] = c->patches.at(patchStart + i);
+            slot->patches[i].pos -= outStart;
+        }
+    }
+    c->out += '\n';
+    c->stats.propertyAllocations += AllocCounter::threadCount() - allocs;
+}
+
+bool Annotate::writeOutput(const QString &fnOut, QVector<Chunk> *chunks)
+{
+    // the header is not part of the chunks, so they can be kept in the cache
+    QByteArray header;
+    writeHeader(&header);
+    m_stats.bytesOut += header.size();
+    if (Compression::fromFileName(fnOut) != Compression::None) {
+        // the blocks are compressed on the thread of the stream while the
+        // next one is resolved
+        StreamOutput out(outputBlockSize);
+        if (!out.open(fnOut)) {
+            m_lastError = (out.status() == StreamUnsupported) ? CompressionNotSupported : OutputFileCreationError;
+            return false;
+        }
+        log("writing %s output to \"%s\"\n", Compression::name(out.format()), qPrintable(fnOut));
+        // the queue shares the block, so it is copied once by the next append
+        bool ok = out.write(header) && emitChunks(chunks, [&out](const QByteArray &block) -> bool {
+            return out.write(block);
+        });
+        if (!ok || !out.close()) {
+            m_lastError = outputError(out);
+            return false;
+        }
+        return true;
+    }
+    QFile f(fnOut);
+    if (!f.open(QFile::Truncate | QIODevice::WriteOnly | QIODevice::Unbuffered)) {
+        m_lastError = OutputFileCreationError;
+        return false;
+    }
+    log("writing to \"%s\"\n", qPrintable(fnOut));
+    bool ok = (f.write(header) == header.size()) && emitChunks(chunks, [&f](const QByteArray &block) -> bool {
+        return f.write(block) == block.size();
+    });
+    if (!ok) {
+        m_lastError = OutputFileWriteError;
+        return false;
+    }
+    return true;
+}
+
+bool Annotate::processStream(const QString &fnIn, const QString &fnOut, bool *isOverlay)
+{
+    // the input is read in blocks of this size, output without pending
+    // patches is written in blocks of this size
+    const int blockSize = 1024*1024;
+    // fixups are only resolved with the whole overlay in memory
+    m_fixups.clear();
+    m_localFixups.clear();
+    m_overlay = false;
+
+    // compressed input is decompressed on a thread of its own, which runs
+    // in parallel to the annotation
+    if ((fnIn != "-") && !QFile::exists(fnIn)) {
+        m_lastError = InputFileNotFound;
+        return false;
+    }
+    StreamInput in(blockSize);
+    if (!in.open(fnIn)) {
+        m_lastError = (in.status() == StreamUnsupported) ? CompressionNotSupported : InputFileOpenError;
+        return false;
+    }
+    StreamOutput out(blockSize);
+    if (!out.open(fnOut)) {
+        m_lastError = (out.status() == StreamUnsupported) ? CompressionNotSupported : OutputFileCreationError;
+        return false;
+    }
+    if ((in.format() != Compression::None) || (out.format() != Compression::None))
+        log("%s input, %s output", Compression::name(in.format()), Compression::name(out.format()));
+    log("streaming from \"%s\" to \"%s\"", qPrintable(fnIn), qPrintable(fnOut));
+    QElapsedTimer timer;
+    timer.start();
+    m_allocCount = AllocCounter::count();
+
+    QVector<Chunk> chunks(1);
+    Chunk *c = chunks.data();
+    c->first = 0;
+    c->last = 0;
+    c->stats = Statistics();
+    c->cached = false;
+    c->out.reserve(blockSize + blockSize/4);
+    c->nodes.reserve(64);
+    m_tree.clear();
+    writeHeader(&c->out);
+
+    // labels are known once the "__symbols__" node has been read, phandles
+    // once their node has been read, too. The output is written up to the
+    // line of the first patch that refers to anything not known yet, the
+    // rest is held back and moved to a temporary file whenever it grows
+    // beyond the memory limit
+    m_labels.clear();
+    m_handleTokens.clear();
+    m_sparseTokens.clear();
+    bool symbolsRead = false;
+    // symbols of nodes not read yet by the hash of their path and their
+    // index, the hash of the path of every node read so far
+    QVector<QPair<uint, int>> pendingLabels;
+    QVector<uint> pathHashes;
+    QVector<bool> handleRead;
+    int handlesDone = 0;
+    auto labelsUpTo = [&](int node) {
+        // the label of every node is looked up once
+        while (m_labels.size() <= node) {
+            int n = m_labels.size();
+            uint h = 0;
+            if (n != NodeTree::root) {
+                const QByteArray &name = m_tree.name(n);
+                h = qHashBits(name.constData(), static_cast<size_t>(name.size()), pathHashes.at(m_tree.parent(n)));
+            }
+            pathHashes.append(h);
+            QByteArray label;
+            auto it = std::lower_bound(pendingLabels.constBegin(), pendingLabels.constEnd(), qMakePair(h, 0));
+            for (; (it != pendingLabels.constEnd()) && (it->first == h); ++it) {
+                // later definitions win
+                const auto &s = c->symbols.at(it->second);
+                if (m_tree.find(s.first) == n)
+                    label = s.second;
+            }
+            m_labels.append(label);
+        }
+    };
+    auto readSymbols = [&]() {
+        QVector<QPair<int, int>> found;
+        for (int i=0; i<c->symbols.size(); ++i) {
+            const QByteArray &path = c->symbols.at(i).first;
+            int node = m_tree.find(path);
+            if (node >= 0) {
+                found.append(qMakePair(node, i));
                 continue;
             }
-            QStringList sl = l.split("=");
-            QString name = sl[0].trimmed();
-            if (m_singleHandleParams.contains(name)) {
-                // only a simple phandle exchange is required
-                QString h = getParameters(l);
-                l.replace(h, handleToSymbol(h, handles, symbols));
-            } else if (m_firstHandleParams.contains(name)) {
-                // only very first parameter is a phandle
-                const QStringList h = getParameters(l).split(" ");
-                l = leftOfParameters(l) + "<" + handleToSymbol(h[0], handles, symbols);
-                if (name.contains("gpio")) {
-                    l += " " + rkGPIO(h[1]);
-                    if (h.size() > 2) {
-                        l + " " + gpioType(h[2]);
-                    }
-                    l += ">;";
-                } else {
-                    // join all parameters after converting from hex to dec
-                    for (int i=1; i< h.size(); ++i) {
-                        l += " " + hex2dec(h[i]);
-                    }
-                    l += ">;";
-                }
-            } else if (m_listHandleParams.contains(name)) {
-                // all parameters are phandles
-                QStringList h = getParameters(l).split(" ");
-                l = leftOfParameters(l);
-                for (int i=0; i<h.size(); ++i) {
-                    l += "<" + handleToSymbol(h[i], handles, symbols) + ">" + separator(i==h.size()-1);
+            // the same hash as above, one name after the other
+            uint h = 0;
+            int from = 1;
+            while (from <= path.size()) {
+                int to = path.indexOf('/', from);
+                if (to < 0)
+                    to = path.size();
+                h = qHashBits(path.constData() + from, static_cast<size_t>(to - from), h);
+                from = to + 1;
+            }
+            pendingLabels.append(qMakePair(h, i));
+        }
+        std::sort(pendingLabels.begin(), pendingLabels.end());
+        // in order, so later definitions win as in mergeTables()
+        for (const auto &f : qAsConst(found)) {
+            labelsUpTo(f.first);
+            m_labels[f.first] = c->symbols.at(f.second).second;
+        }
+        symbolsRead = true;
+    };
+    auto readHandles = [&]() {
+        // the same tokens as in mergeTables()
+        for (; handlesDone < c->handles.size(); ++handlesDone) {
+            const auto &h = c->handles.at(handlesDone);
+            QByteArray token;
+            if (h.second >= 0) {
+                labelsUpTo(h.second);
+                if (!m_labels.at(h.second).isEmpty())
+                    token = "&" + m_labels.at(h.second);
+                else if (m_pathReferences)
+                    token = "&{" + m_tree.path(h.second) + "}";
+            }
+            if (h.first <= maxDenseHandle) {
+                if (h.first >= static_cast<quint32>(m_handleTokens.size())) {
+                    m_handleTokens.resize(h.first + 1);
+                    handleRead.resize(h.first + 1);
                 }
+                m_handleTokens[h.first] = token;
+                handleRead[h.first] = true;
             } else {
-                // special handling
-                if ((name == "clocks") || (name=="dmas") || (name=="assigned-clocks")) {
-                    QStringList h = getParameters(l).split(" ");
-                    l = leftOfParameters(l);
-                    int n = h.size();
-                    if (n==1) {
-                        l += "<" + handleToSymbol(h[0], handles, symbols) + ">;";
-                    } else {
-                        for (int i=0; i<n; i+=2) {
-                            l += "<" + handleToSymbol(h[i], handles, symbols) + " " + hex2dec(h[i+1]) + ">" + separator(i==n-2);
-                        }
-                    }
-                } else if (name == "rockchip,pins") {
-                    QStringList h = getParameters(l).split(" ");
-                    l = leftOfParameters(l) + QString("<RK_GPIO%1 ").arg(h[0].toInt(nullptr, 0));
-                    l += rkGPIO(h[1]);
-                    uint n = h[2].toUInt(nullptr, 0);
-                    if (n==0) {
-                        l += " RK_FUNC_GPIO";
-                    } else {
-                        l += QString(" RK_FUNC_%1").arg(n);
-                    }
-                    l += " " + handleToSymbol(h[3], handles, symbols) + ">;";
-                } else if (name == "rockchip,power-ctrl") {
-                    QStringList h = getParameters(l).split(" ");
-                    l = leftOfParameters(l);
-                    int n = h.size();
-                    for (int i=0; i<n; i+=3) {
-                        l += "<" + handleToSymbol(h[i], handles, symbols) + " " + rkGPIO(h[i+1]) + " " + gpioType(h[i+2]) + ">" + separator(i==n-3);
-                    }
-                } else if (name == "interrupts") {
-                    QStringList h = getParameters(l).split(" ");
-                    int n = h.size();
-                    l = leftOfParameters(l);
-                    if (n%4==0) {
-                        for (int i=0; i<n; i+=4) {
-                            l += "<" + interruptController(h[i]) + " " + hex2dec(h[i+1]) + " " + irqType(h[i+2]) + " " + hex2dec(handleToSymbol(h[i+3], handles, symbols)) + ">" + separator(i==n-4);
-                        }
-                    } else {
-                        for (int i=0; i<n; i+=2) {
-                            l += "<" + rkGPIO(h[i]) + " " + hex2dec(h[i+1]) + ">" + separator(i==n-2);
-                        }
-                    }
-                } else if (name == "interrupt-map") {
-                    QStringList h = getParameters(l).split(" ");
-                    int n = h.size();
-                    l = leftOfParameters(l);
-                    if (n%6==0) {
-                        for (int i=0; i<n; i+=6) {
-                            l += "<" + hex2dec(h[i]) + " " + hex2dec(h[i+1]) + " " + hex2dec(h[i+2]) + " " + hex2dec(h[i+3]) + " " + handleToSymbol(h[i+4], handles, symbols) + " " + hex2dec(h[i+5]) + ">" + separator(i==n-6);
-                        }
-                    } else {
-                        for (int i=0; i<n; i+=2) {
-                            l += "<" + rkGPIO(h[i]) + " " + hex2dec(h[i+1]) + ">" + separator(i==n-2);
-                        }
-                    }
-                } else {
-                    // convert regular parameters to decimal numbers
-                    if (sl.size()>1) {
-                        if (sl[1].trimmed().startsWith('"')) {
-                            // string parameters
-                            // nothing to do
-                            ;
-                        } else if (!name.contains("reg")) {
-                            // numeric parameter list
-                            const QStringList h = getParameters(l).split(" ");
-                            l = leftOfParameters(l) + "<";
-                            for (const auto& s : h) {
-                                l += hex2dec(s) + " ";
-                            }
-                            l.chop(1);
-                            l += ">;";
-                        }
-                    }
+                m_sparseTokens.insert(h.first, token);
+            }
+        }
+    };
+    auto isKnown = [&](const Patch &p) -> bool {
+        if (p.type == LabelPatch) {
+            if (p.node >= 0)
+                labelsUpTo(p.node);
+            return true;
+        }
+        if (p.handle < static_cast<quint32>(handleRead.size()))
+            return handleRead.at(p.handle);
+        return m_sparseTokens.contains(p.handle);
+    };
+    // the output and the patches before these are written, they are
+    // removed once they are half of the chunk
+    int written = 0;
+    int done = 0;
+    int known = 0;
+    auto compact = [&]() {
+        c->out.remove(0, written);
+        c->patches.remove(0, done);
+        for (auto &p : c->patches)
+            p.pos -= written;
+        known -= done;
+        written = 0;
+        done = 0;
+    };
+    auto flush = [&]() -> bool {
+        // a patch stays known, the lines held back stay complete
+        while ((known < c->patches.size()) && isKnown(c->patches.at(known)))
+            ++known;
+        int end = c->out.size();
+        int k = known;
+        if (k < c->patches.size()) {
+            int pos = c->patches.at(k).pos;
+            end = (pos > written) ? c->out.lastIndexOf('\n', pos - 1) + 1 : written;
+            while ((k > done) && (c->patches.at(k - 1).pos >= end))
+                --k;
+        }
+        if (end <= written)
+            return true;
+        if (!m_xrefFile.isEmpty())
+            collectReferences(*c, done, k);
+        // in blocks, so the output stream starts on the first one while
+        // the rest is resolved
+        QByteArray block;
+        block.reserve(blockSize + blockSize/4);
+        auto write = [&]() -> bool {
+            if (!out.write(block)) {
+                m_lastError = outputError(out);
+                return false;
+            }
+            m_stats.bytesOut += block.size();
+            block.resize(0);
+            return true;
+        };
+        int pos = written;
+        for (int i=done; i<k; ++i) {
+            const Patch &p = c->patches.at(i);
+            block.append(c->out.constData() + pos, p.pos - pos);
+            resolvePatch(c, p, &block);
+            pos = p.pos + p.len;
+            if ((block.size() >= blockSize) && !write())
+                return false;
+        }
+        block.append(c->out.constData() + pos, end - pos);
+        if (!write())
+            return false;
+        written = end;
+        done = k;
+        if (written >= c->out.size() - written)
+            compact();
+        return true;
+    };
+    QTemporaryFile spill;
+    bool spilled = false;
+    int flushAt = blockSize;
+    ScanLease lease(this);
+    auto feed = [&](const QByteArray &l, const LineInfo &info) -> bool {
+        bool inSymbols = !c->nodes.isEmpty() && m_tree.isSymbols(c->nodes.last());
+        scanLine(c, l, info, lease.state());
+        ++m_stats.lines;
+        if (isOverlay && (info.open > 0) && (c->nodes.size() == 2)) {
+            // the caller annotates overlays with fixups as a whole
+            const QByteArray name = l.left(info.open).trimmed();
+            if ((name == "__fixups__") || (name == "__local_fixups__")) {
+                *isOverlay = true;
+                return false;
+            }
+        }
+        if (inSymbols && !symbolsRead && (c->nodes.isEmpty() || !m_tree.isSymbols(c->nodes.last())))
+            readSymbols();
+        if (symbolsRead)
+            readHandles();
+        int held = c->out.size() - written;
+        if (!spilled && (held >= flushAt)) {
+            if ((done == c->patches.size()) || symbolsRead) {
+                if (!flush())
+                    return false;
+            }
+            // a block more before the next try, if patches are held back
+            flushAt = c->out.size() - written + blockSize;
+        }
+        if ((spilled || (done < c->patches.size()))
+                && (c->out.size() - written + (c->patches.size() - done) * static_cast<qint64>(sizeof(Patch)) >= m_maxMemory/2)) {
+            compact();
+            if (!m_xrefFile.isEmpty())
+                collectReferences(*c);
+            if (!spillChunk(&spill, c)) {
+                m_lastError = TemporaryFileError;
+                return false;
+            }
+            spilled = true;
+        }
+        return true;
+    };
+
+    QByteArray buf(blockSize, Qt::Uninitialized);
+    QVector<LineInfo> lines;
+    QByteArray line;
+    int used = 0;
+    qint64 total = 0;
+    bool checked = false;
+    bool eof = false;
+    while (!eof) {
+        if (used == buf.size()) {
+            // a line longer than the buffer
+            buf.resize(2*buf.size());
+        }
+        qint64 n = in.read(buf.data() + used, buf.size() - used);
+        if (n < 0) {
+            m_lastError = (in.status() == StreamDataError) ? CompressionError : InputFileReadError;
+            return false;
+        }
+        eof = (n == 0);
+        used += static_cast<int>(n);
+        total += n;
+        if (!checked) {
+            if (!eof && (used < 40))
+                continue;
+            checked = true;
+            if (DtbReader::isBlob(buf.constData(), used)) {
+                // a blob is decompiled as a whole, it is much smaller than the source
+                QByteArray blob = buf.left(used) + in.readAll();
+                QByteArray dts;
+                DtbReader dtb;
+                if (!dtb.toSource(blob.constData(), blob.size(), &dts)) {
+                    m_lastError = InputFormatError;
+                    return false;
                 }
+                log("decompiled device tree blob to %d bytes", dts.size());
+                total = blob.size();
+                buf = dts;
+                used = dts.size();
+                eof = true;
+            }
+        }
+        // all complete lines, the text after the last newline is a line
+        // of its own at the end of the input
+        const char *d = buf.constData();
+        LineClassifier::classify(d, used, &lines);
+        int complete = eof ? ((total > 0) ? lines.size() : 0) : lines.size() - 1;
+        for (int i=0; i<complete; ++i) {
+            line.setRawData(d + lines[i].offset, static_cast<uint>(lines[i].length));
+            if (!feed(line, lines[i]))
+                return false;
+        }
+        int from = eof ? used : lines.last().offset;
+        memmove(buf.data(), buf.constData() + from, used - from);
+        used -= from;
+    }
+    if (total == 0) {
+        m_lastError = InputFileReadError;
+        return false;
+    }
+    if (in.format() != Compression::None)
+        log("read %lld bytes, %lld compressed", total, in.compressedBytes());
+    else
+        log("read %lld bytes", total);
+    m_stats.bytesIn = total;
+    endStage(ScanStage, &timer);
+
+    compact();
+    if (symbolsRead) {
+        // the tables are complete but for the nodes without patches
+        labelsUpTo(m_tree.size() - 1);
+    } else {
+        mergeTables(chunks);
+    }
+    endStage(MergeStage, &timer);
+    if (!m_xrefFile.isEmpty())
+        collectReferences(*c);
+    // the held back output is resolved into blocks, see emitChunks()
+    auto write = [&out](const QByteArray &block) -> bool {
+        return out.write(block);
+    };
+    if (spilled) {
+        // resolve and write the held back output part by part
+        if (!spillChunk(&spill, c) || !spill.seek(0)) {
+            m_lastError = TemporaryFileError;
+            return false;
+        }
+        while (!spill.atEnd()) {
+            if (!readSpilled(&spill, c)) {
+                m_lastError = TemporaryFileError;
+                return false;
             }
+            if (!emitChunks(&chunks, write)) {
+                m_lastError = outputError(out);
+                return false;
+            }
+            c->stats = Statistics();
         }
-        tsOut << l << "\n";
+    } else if (!emitChunks(&chunks, write)) {
+        m_lastError = outputError(out);
+        return false;
     }
+    if (m_stats.unresolved > 0)
+        log("%d phandle references without symbol", m_stats.unresolved);
+    bool ok = out.close();
+    if (!ok)
+        m_lastError = outputError(out);
+    if (ok && !m_xrefFile.isEmpty() && !writeXref(chunks)) {
+        m_lastError = XrefFileWriteError;
+        ok = false;
+    }
+    endStage(WriteStage, &timer);
+    m_stats.peakMemory = peakMemory();
+    return ok;
+}
+
+bool Annotate::spillChunk(QTemporaryFile *spill, Chunk *c)
+{
+    // the output and its patches as one segment, the patch positions are
+    // relative to the segment
+    if (!spill->isOpen() && !spill->open())
+        return false;
+    qint32 head[2] = { c->out.size(), c->patches.size() };
+    qint64 patchBytes = c->patches.size() * static_cast<qint64>(sizeof(Patch));
+    if ((spill->write(reinterpret_cast<const char*>(head), sizeof(head)) != sizeof(head))
+            || (spill->write(reinterpret_cast<const char*>(c->patches.constData()), patchBytes) != patchBytes)
+            || (spill->write(c->out) != c->out.size()))
+        return false;
+    c->out.resize(0);
+    c->patches.resize(0);
     return true;
 }
 
+bool Annotate::readSpilled(QTemporaryFile *spill, Chunk *c)
+{
+    qint32 head[2];
+    if ((spill->read(reinterpret_cast<char*>(head), sizeof(head)) != sizeof(head)) || (head[0] < 0) || (head[1] < 0))
+        return false;
+    c->out.resize(head[0]);
+    c->patches.resize(head[1]);
+    qint64 patchBytes = c->patches.size() * static_cast<qint64>(sizeof(Patch));
+    return (spill->read(reinterpret_cast<char*>(c->patches.data()), patchBytes) == patchBytes)
+            && (spill->read(c->out.data(), c->out.size()) == c->out.size());
+}
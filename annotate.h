@@ -13,54 +13,309 @@
 #define ANNOTATE_H
 
 #include <QString>
-#include <QTextStream>
 #include <QHash>
-#include <QSet>
+#include <QVector>
+#include <QMutex>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include <functional>
+#include <limits.h>
+#include "sourcebuffer.h"
+#include "celllist.h"
+#include "nodetree.h"
+#include "propertytable.h"
+#include "xrefindex.h"
+
+class QTemporaryFile;
+class StreamOutput;
+class QJsonObject;
+class QElapsedTimer;
 
 class Annotate
 {
 public:
     Annotate(bool beQiet = false);
+    ~Annotate();
 
     typedef enum {
         noError = 0,
         InputFileNotFound,
         InputFileOpenError,
         InputFileReadError,
+        InputFormatError,
         OutputFileCreationError,
-        OutputFileWriteError
+        OutputFileWriteError,
+        TemporaryFileError,
+        CacheFileWriteError,
+        XrefFileWriteError,
+        CompressionError,
+        CompressionNotSupported,
+        StreamNotSupported
     } ErrCodes;
 
+    typedef enum {
+        ReadStage = 0,      // map the input, index the lines, decompile a blob
+        SplitStage,         // split into chunks for the threads
+        ScanStage,          // annotate all lines, collect symbols and phandles
+        MergeStage,         // build the label and phandle tables
+        ResolveStage,       // insert labels and symbols
+        WriteStage,         // write the output file
+        StageCount
+    } Stage;
+
+    // figures of the last file
+    typedef struct {
+        qint64  stageTime[StageCount];  // nanoseconds
+        qint64  bytesIn;        // size of the input file or stream
+        qint64  bytesOut;
+        qint64  lines;          // source lines, after decompiling a blob
+        int     nodes;
+        int     properties[PropertyTable::HandlerCount];
+        int     numeric;        // plain properties converted to decimal numbers
+        int     labels;         // labels added to nodes
+        int     resolved;       // phandle references replaced by a label
+        int     unresolved;     // phandle references without symbol
+        int     cacheLookups;   // property lines looked up in the cache of annotated lines
+        int     cacheHits;      // and copied from it
+        qint64  peakMemory;     // peak resident size of the process in bytes, 0 if unknown
+        qint64  allocations[StageCount];    // heap allocations, debug and benchmark builds only
+        qint64  propertyAllocations;        // of property lines, none but for the fixups of overlays
+        qint64  nodeAllocations;            // of node lines without new nodes, none
+    } Statistics;
+
+    // labels of a base tree with the paths of their nodes
+    typedef QHash<QByteArray, QByteArray> SymbolTable;
+
     static QString errString(ErrCodes err);
+    static const char *stageName(Stage stage);
+    // human readable and JSON form of the statistics
+    static QString statisticsText(const Statistics &s);
+    static QJsonObject statisticsJson(const Statistics &s);
+    // a whole file or stdin ("-"), decompressed if needed
+    static ErrCodes readAll(const QString &fn, QByteArray *data);
 
+    // "-" reads from stdin or writes to stdout and selects the streaming mode
     bool process(const QString &fnIn, const QString &fnOut);
+    // annotate a source or blob in memory, an instance may be used for
+    // any number of calls and keeps its threads between them
+    bool annotate(const QByteArray &in, QByteArray *out);
     QString errString();
+    ErrCodes lastError() const;
+    // number of threads used to annotate one file, 0 for one per core
+    void setThreads(int threads);
+    // memory limit in streaming mode, pending output is moved to a
+    // temporary file beyond that
+    void setMaxMemory(qint64 bytes);
+    // keep the annotated parts of the last file, the next run only
+    // re-annotates top-level nodes that changed
+    void setIncremental(bool on);
+    // incremental mode with the state kept in a file between runs
+    void setCacheFile(const QString &fn);
+    // write an index of the phandle references next to the output,
+    // empty for none
+    void setXrefFile(const QString &fn);
+    // read the labels of a base tree, to annotate overlays against it
+    bool loadBase(const QString &fn, SymbolTable *symbols);
+    // overlay mode: the references listed in "__fixups__" are written as
+    // labels of the base tree. The table is only read, so any number of
+    // instances may share it
+    void setBase(const QSharedPointer<const SymbolTable> &base);
+    // write references to nodes without a label as "&{/path}" instead of
+    // the phandle number
+    void setPathReferences(bool on);
+    // number of phandle references without a symbol in the last file
+    int unresolvedHandles() const { return m_stats.unresolved; }
+    // time of a processing stage of the last file in nanoseconds, in
+    // streaming mode reading is part of the scan, resolving part of writing
+    qint64 stageTime(Stage stage) const { return m_stats.stageTime[stage]; }
+    const Statistics &statistics() const { return m_stats; }
 
 
 private:
-    typedef QHash<QString, QString> StringHash;
-    typedef  QList<QByteArray> ByteArrayList;
+    typedef enum {
+        LabelPatch,         // label of the current node
+        HandlePatch,        // phandle, unchanged if unresolved
+        HandleDecPatch      // phandle, decimal number if unresolved
+    } PatchType;
+
+    typedef struct {
+        int         pos;    // insert position in m_out
+        int         len;    // length of the phandle text
+        PatchType   type;
+        quint32     handle; // phandle, 0 if the text is no number
+        int         node;   // node of a label or of the property with a phandle
+    } Patch;
+
+    typedef struct {
+        int             first;      // line range of the chunk
+        int             last;
+        QVector<int>    nodes;      // node path at the start, empty before the root node
+        QByteArray      out;        // annotated output with patches
+        QVector<Patch>  patches;
+        QVector<QPair<QByteArray, QByteArray> > symbols;    // path and label
+        QVector<QPair<quint32, int> > handles;              // phandle and node
+        QVector<XrefIndex::Edge> fixups;    // references resolved against the base tree
+        Statistics      stats;      // counters of this chunk only
+        QByteArray      hash;       // content and start path, incremental mode only
+        QByteArray      tokens;     // hash of the labels and phandles it was resolved with
+        bool            cached;     // scanned in an earlier run
+    } Chunk;
+
+    // prefix scan of the node path that cuts the lines into chunks, see
+    // splitLines()
+    typedef struct {
+        Chunk           c;          // the chunk being cut
+        QVector<int>    nodes;      // node path at the next line
+        QVector<bool>   live;       // nodes of this file
+        int             liveNodes;
+        int             minLines;
+        int             maxDepth;
+        int             next;       // first line not split yet
+        bool            cut;        // false for a single chunk
+    } SplitState;
+
+    // a chunk of the last run in incremental mode
+    typedef struct {
+        Chunk           scanned;    // annotated, not resolved yet
+        QByteArray      tokens;
+        QByteArray      out;        // resolved output
+        Statistics      stats;      // of the resolved chunk
+    } CacheEntry;
+
+    // an annotated property line in the fixed storage of its slot, see
+    // scanLine()
+    typedef struct {
+        uint            hash;
+        bool            valid;      // false if the line was seen only once
+        int             lineLen;
+        int             outLen;     // without the newline
+        int             patchCount;
+        char           *line;
+        char           *out;
+        Patch          *patches;    // positions relative to the line
+    } CacheSlot;
+
+    // state of the lines scanned by one thread, kept for the next chunk
+    // and the next file
+    typedef struct {
+        Arena           arena;      // temporaries, reset at every node
+        QVector<CacheSlot> cache;   // recently annotated lines by hash
+        QByteArray      storage;    // of all slots, allocated once
+        bool            overlay;    // m_overlay of the cached lines
+    } ScanState;
+
+    // a scan state of the instance, taken for the lifetime of the lease
+    class ScanLease
+    {
+    public:
+        explicit ScanLease(Annotate *a) : m_a(a), m_state(a->acquireState()) {}
+        ~ScanLease() { m_a->releaseState(m_state); }
+        ScanState *state() const { return m_state; }
+    private:
+        Annotate       *m_a;
+        ScanState      *m_state;
+    };
 
     bool            m_beQuiet;
     ErrCodes        m_lastError;
-    QSet<QString>   m_singleHandleParams;
-    QSet<QString>   m_firstHandleParams;
-    QSet<QString>   m_listHandleParams;
+    int             m_threads;
+    QThreadPool     m_pool;
+
+    // nodes, labels and handles of the whole file
+    NodeTree        m_tree;
+    QVector<QByteArray>     m_labels;
+    QVector<QByteArray>     m_handleTokens;     // "&label" by phandle
+    QHash<quint32, QByteArray> m_sparseTokens;  // phandles too large for the vector
+    qint64          m_maxMemory;
+    Statistics      m_stats;
+
+    // incremental mode
+    bool            m_incremental;
+    QString         m_cacheFile;
+    bool            m_cacheLoaded;
+    QHash<QByteArray, CacheEntry> m_cache;      // by chunk hash
+
+    bool            m_pathReferences;
+    qint64          m_allocCount;   // at the end of the last stage
+
+    // scan states not in use, at most one per thread that scans at a time
+    QMutex          m_statesMutex;
+    QVector<ScanState*> m_states;
+
+    // overlay mode
+    QSharedPointer<const SymbolTable> m_base;
+    bool            m_overlay;      // a base tree is loaded or the file has "__fixups__"
+    QHash<QByteArray, QByteArray> m_fixups;     // label by "path:property:offset"
+    QHash<QByteArray, QVector<int> > m_localFixups;    // offsets of phandles by "path:property"
+
+    // cross-reference index
+    QString         m_xrefFile;
+    QVector<XrefIndex::Edge> m_edges;
+
+    // larger phandles are not assigned by dtc
+    static const quint32 maxDenseHandle = 0xfffff;
+    // resolved output is written in blocks of this size, see emitChunks()
+    static const int outputBlockSize = 1024*1024;
 
     void log(const char *fmt, ...);
-    StringHash createHandleHash(ByteArrayList &ts);
-    StringHash createSymbolHash(ByteArrayList &ts);
-    bool writeOutput(const QString &fnOut, ByteArrayList &tsIn, const StringHash &symbols, const StringHash &handles);
-    bool adjustPath(QString *path, const QString &line);
-    const QString getParameters(const QString &line);
-    const QString handleToSymbol(const QString &h, const StringHash &handles, const StringHash &symbols);
-    const QString leftOfParameters(const QString l) { return l.split("=")[0] + "= "; }
-    const QString separator(bool last) { return (last ? ";" : ", "); }
-    const QString rkGPIO(const QString &x);
-    const QString gpioType(const QString &x);
-    const QString hex2dec(const QString &x);
-    const QString interruptController(const QString &x);
-    const QString irqType(const QString &x);
+    void endStage(Stage stage, QElapsedTimer *timer);
+    void addCounters(const Chunk &c);
+    void writeHeader(QByteArray *out);
+    bool decompile(SourceBuffer *src);
+    static ErrCodes outputError(const StreamOutput &out);
+    bool annotateSource(SourceBuffer *src, QVector<Chunk> *chunks, QElapsedTimer *timer);
+    bool annotateCompressed(const QString &fn, SourceBuffer *src, QVector<Chunk> *chunks, QElapsedTimer *timer);
+    bool finishChunks(SourceBuffer *src, QVector<Chunk> *chunks, QElapsedTimer *timer);
+    void prepareCache();
+    void loadFixups(const SourceBuffer &src);
+    int loadBaseFixups(LineWindow *lines, int inx);
+    int loadLocalFixups(LineWindow *lines, int inx);
+    bool appendFixup(Chunk *c, const QByteArray &property, int cell);
+    const QVector<int> *localFixups(const Chunk *c, const char *name, int len) const;
+    QVector<Chunk> splitChunks(const SourceBuffer &src);
+    void beginSplit(SplitState *s, int lines);
+    void splitLines(const SourceBuffer &src, int to, SplitState *s, QVector<Chunk> *chunks);
+    bool endSplit(const SourceBuffer &src, SplitState *s, QVector<Chunk> *chunks);
+    void hashChunk(const SourceBuffer &src, Chunk *c);
+    void runChunks(QVector<Chunk> *chunks, const std::function<void(Chunk*)> &f);
+    ScanState *acquireState();
+    void releaseState(ScanState *state);
+    void scanChunk(const SourceBuffer &src, Chunk *c);
+    void scanLine(Chunk *c, const QByteArray &l, const LineInfo &info, ScanState *state);
+    void mergeTables(const QVector<Chunk> &chunks);
+    void resolveChunk(Chunk *c);
+    void reuseChunks(QVector<Chunk> *chunks);
+    bool reuseChunk(Chunk *c);
+    void resolveIncremental(Chunk *c);
+    void updateCache(const QVector<Chunk> &chunks, QHash<QByteArray, CacheEntry> *next);
+    bool loadCache();
+    bool saveCache();
+    // of the patches [from, to)
+    void collectReferences(const Chunk &c, int from = 0, int to = INT_MAX);
+    bool writeXref(const QVector<Chunk> &chunks);
+    bool emitChunks(QVector<Chunk> *chunks, const std::function<bool(const QByteArray&)> &write);
+    bool writeOutput(const QString &fnOut, QVector<Chunk> *chunks);
+    bool processStream(const QString &fnIn, const QString &fnOut, bool *isOverlay = nullptr);
+    bool spillChunk(QTemporaryFile *spill, Chunk *c);
+    bool readSpilled(QTemporaryFile *spill, Chunk *c);
+    void addSymbol(Chunk *c, const QByteArray &line);
+    void addHandle(Chunk *c, const QByteArray &line, const LineInfo &info);
+    void appendHandle(Chunk *c, const Cell &h, PatchType type = HandlePatch);
+    void appendHandle(Chunk *c, const CellList &h, int inx, PatchType type = HandlePatch);
+    void appendLabel(Chunk *c);
+    void resolvePatch(Chunk *c, const Patch &p, QByteArray *out);
+    bool adjustPath(QVector<int> *nodes, const QByteArray &line, const LineInfo &info);
+    // "phandle = <0x..>" needs a '=' and a '<'
+    bool isHandleDefinition(const QByteArray &l, const LineInfo &info) { return (info.eq >= 0) && (info.lt >= 0) && l.contains("phandle = <0x"); }
+    const QByteArray &handleToken(quint32 h) const;
+    void appendLeftOfParameters(Chunk *c, const QByteArray &l, const LineInfo &info);
+    const char *endOfCells(bool last) { return (last ? ">;" : ">, "); }
+    // cells are formatted straight into the output
+    void rkGPIO(QByteArray *out, const Cell &x);
+    void gpioType(QByteArray *out, const Cell &x);
+    void hex2dec(QByteArray *out, const Cell &x);
+    void interruptController(QByteArray *out, const Cell &x);
+    void irqType(QByteArray *out, const Cell &x);
 };
 
 #endif // ANNOTATE_H
@@ -0,0 +1,48 @@
+# annotation engine, shared by the command line tool and the benchmark
+
+INCLUDEPATH += $$PWD
+
+# peak memory in the statistics
+win32: LIBS += -lpsapi
+
+# compressed input and output: gzip with zlib, xz and zstd if found
+LIBS += -lz
+unix {
+    CONFIG += link_pkgconfig
+    packagesExist(liblzma) {
+        PKGCONFIG += liblzma
+        DEFINES += DT_ANNOTATE_XZ
+    }
+    packagesExist(libzstd) {
+        PKGCONFIG += libzstd
+        DEFINES += DT_ANNOTATE_ZSTD
+    }
+}
+
+# heap allocations in the statistics, debug and benchmark builds only
+CONFIG(debug, debug|release)|count_allocs: DEFINES += DT_ANNOTATE_COUNT_ALLOCS
+
+SOURCES += \
+        $$PWD/alloccounter.cpp \
+        $$PWD/annotate.cpp \
+        $$PWD/arena.cpp \
+        $$PWD/celllist.cpp \
+        $$PWD/compressedstream.cpp \
+        $$PWD/dtbreader.cpp \
+        $$PWD/lineclassifier.cpp \
+        $$PWD/nodetree.cpp \
+        $$PWD/sourcebuffer.cpp \
+        $$PWD/xrefindex.cpp
+
+HEADERS += \
+    $$PWD/alloccounter.h \
+    $$PWD/annotate.h \
+    $$PWD/arena.h \
+    $$PWD/celllist.h \
+    $$PWD/compressedstream.h \
+    $$PWD/dtbreader.h \
+    $$PWD/lineclassifier.h \
+    $$PWD/nodetree.h \
+    $$PWD/propertytable.h \
+    $$PWD/sourcebuffer.h \
+    $$PWD/xrefindex.h
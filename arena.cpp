@@ -0,0 +1,66 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// arena.cpp
+// monotonic allocator for per-line temporaries
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "arena.h"
+#include <stdlib.h>
+
+namespace {
+
+const int alignment = 16;
+
+} // namespace
+
+Arena::Arena(int blockSize)
+    : m_blockSize(blockSize)
+    , m_pos(0)
+    , m_used(0)
+{
+}
+
+Arena::~Arena()
+{
+    for (const auto &b : qAsConst(m_blocks))
+        free(b.data);
+}
+
+void *Arena::allocate(int size)
+{
+    size = (size + alignment - 1) & ~(alignment - 1);
+    if (m_blocks.isEmpty() || (m_pos + size > m_blocks.last().size)) {
+        // a new block, at least as large as the request
+        Block b;
+        b.size = qMax(m_blockSize, size);
+        b.data = static_cast<char*>(malloc(static_cast<size_t>(b.size)));
+        Q_CHECK_PTR(b.data);
+        m_blocks.append(b);
+        m_pos = 0;
+    }
+    void *p = m_blocks.last().data + m_pos;
+    m_pos += size;
+    m_used += size;
+    return p;
+}
+
+void Arena::reset()
+{
+    if (m_blocks.size() > 1) {
+        // one block for all of it, so the next round fits without growing
+        int size = 0;
+        for (const auto &b : qAsConst(m_blocks)) {
+            size += b.size;
+            free(b.data);
+        }
+        m_blocks.clear();
+        m_blockSize = qMax(m_blockSize, size);
+    }
+    m_pos = 0;
+    m_used = 0;
+}
@@ -0,0 +1,49 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// arena.h
+// header file for arena.cpp
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <QtGlobal>
+#include <QVector>
+
+// monotonic allocator for the temporaries of a line. Memory is only given
+// back as a whole by reset(), which keeps a single block large enough for
+// everything allocated since the last reset, so a scan in steady state
+// does not touch the heap at all
+class Arena
+{
+public:
+    explicit Arena(int blockSize = 64*1024);
+    ~Arena();
+
+    // uninitialized memory for n objects, aligned for any scalar type
+    template <typename T> T *allocate(int n) { return static_cast<T*>(allocate(n * static_cast<int>(sizeof(T)))); }
+    void *allocate(int size);
+    void reset();
+    // bytes allocated since the last reset
+    int used() const { return m_used; }
+
+private:
+    typedef struct {
+        char   *data;
+        int     size;
+    } Block;
+
+    QVector<Block>  m_blocks;
+    int             m_blockSize;
+    int             m_pos;      // in the last block
+    int             m_used;
+
+    Q_DISABLE_COPY(Arena)
+};
+
+#endif // ARENA_H
@@ -0,0 +1,140 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// batch.cpp
+// annotate many device trees in parallel
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "batch.h"
+#include "compressedstream.h"
+#include <QAtomicInt>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <QThreadPool>
+#include <QDebug>
+
+Batch::Batch(bool beQuiet, int jobs)
+    : m_beQuiet(beQuiet)
+    , m_maxJobs(jobs > 0 ? jobs : QThread::idealThreadCount())
+{
+}
+
+void Batch::setOutputDir(const QString &dir)
+{
+    m_outDir = dir;
+}
+
+void Batch::setBase(const QSharedPointer<const Annotate::SymbolTable> &base)
+{
+    m_base = base;
+}
+
+void Batch::setXrefFile(const QString &fn)
+{
+    m_xrefFile = fn;
+}
+
+void Batch::addInput(const QString &arg)
+{
+    if (arg.startsWith('@')) {
+        addListFile(arg.mid(1));
+        return;
+    }
+    QFileInfo fi(arg);
+    if (fi.isDir()) {
+        // all device tree files of the directory
+        const QStringList filter = { "*.dts", "*.dtb", "*.dtbo", "*.dts.gz", "*.dts.xz", "*.dts.zst" };
+        const QFileInfoList fl = QDir(arg).entryInfoList(filter, QDir::Files, QDir::Name);
+        for (const auto &f : fl) {
+            addFile(f.filePath());
+        }
+    } else if (fi.fileName().contains('*') || fi.fileName().contains('?') || fi.fileName().contains('[')) {
+        // wildcard pattern, not expanded by all shells
+        const QFileInfoList fl = fi.dir().entryInfoList(QStringList(fi.fileName()), QDir::Files, QDir::Name);
+        for (const auto &f : fl) {
+            addFile(f.filePath());
+        }
+    } else {
+        // missing files are reported when processed
+        addFile(arg);
+    }
+}
+
+int Batch::run()
+{
+    if (m_jobs.isEmpty())
+        return 0;
+    QThreadPool pool;
+    pool.setMaxThreadCount(qMin(m_maxJobs, m_jobs.size()));
+    // every worker owns its Annotate instance and takes the next job until
+    // all are done, so the line cache of the instance is kept for all files
+    Job *jobs = m_jobs.data();
+    int count = m_jobs.size();
+    bool beQuiet = m_beQuiet;
+    QSharedPointer<const Annotate::SymbolTable> base = m_base;
+    QString xref = m_xrefFile;
+    QAtomicInt next(0);
+    for (int w=0; w<pool.maxThreadCount(); ++w) {
+        pool.start([jobs, count, &next, beQuiet, base, xref]() {
+            Annotate annotator(beQuiet);
+            annotator.setBase(base);
+            annotator.setXrefFile(xref);
+            int i;
+            while ((i = next.fetchAndAddRelaxed(1)) < count) {
+                Job *job = &jobs[i];
+                annotator.process(job->fnIn, job->fnOut);
+                job->err = annotator.lastError();
+                job->stats = annotator.statistics();
+            }
+        });
+    }
+    pool.waitForDone();
+    int failed = 0;
+    for (const auto &j : qAsConst(m_jobs)) {
+        if (j.err != Annotate::noError)
+            ++failed;
+    }
+    return failed;
+}
+
+void Batch::addFile(const QString &fn)
+{
+    Job j;
+    j.fnIn = fn;
+    if (m_outDir.isEmpty()) {
+        j.fnOut = Compression::annotatedName(fn);
+    } else {
+        j.fnOut = QDir(m_outDir).filePath(Compression::annotatedName(QFileInfo(fn).fileName()));
+    }
+    j.err = Annotate::noError;
+    j.stats = Annotate::Statistics();
+    QString key = QFileInfo(j.fnOut).absoluteFilePath();
+    if (m_outputs.contains(key)) {
+        // the same input given twice, or two inputs with the same name
+        qWarning().noquote() << QObject::tr("%1: skipped, \"%2\" is already written from \"%3\"").arg(fn, j.fnOut, m_outputs.value(key));
+        return;
+    }
+    m_outputs.insert(key, fn);
+    m_jobs.append(j);
+}
+
+void Batch::addListFile(const QString &fn)
+{
+    QFile f(fn);
+    if (!f.open(QFile::ReadOnly)) {
+        // let the missing list show up as a failed job
+        addFile(fn);
+        return;
+    }
+    while (!f.atEnd()) {
+        QString l = QString::fromLocal8Bit(f.readLine()).trimmed();
+        if (!l.isEmpty() && !l.startsWith('#'))
+            addInput(l);
+    }
+}
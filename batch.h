@@ -0,0 +1,57 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// batch.h
+// header file for batch.cpp
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "annotate.h"
+#include <QString>
+#include <QHash>
+#include <QVector>
+
+class Batch
+{
+public:
+    Batch(bool beQuiet = false, int jobs = 0);
+
+    typedef struct {
+        QString             fnIn;
+        QString             fnOut;
+        Annotate::ErrCodes  err;
+        Annotate::Statistics stats;
+    } Job;
+
+    void setOutputDir(const QString &dir);
+    // annotate the inputs as overlays of a base tree, the table is shared
+    // by all jobs
+    void setBase(const QSharedPointer<const Annotate::SymbolTable> &base);
+    // cross-reference index of a single input, see Annotate::setXrefFile()
+    void setXrefFile(const QString &fn);
+    // add a file, a directory, a wildcard pattern or a list file ("@file")
+    void addInput(const QString &arg);
+    // annotate all inputs in parallel, returns the number of failed jobs
+    int run();
+    const QVector<Job> &jobs() const { return m_jobs; }
+
+private:
+    bool            m_beQuiet;
+    int             m_maxJobs;
+    QString         m_outDir;
+    QSharedPointer<const Annotate::SymbolTable> m_base;
+    QString         m_xrefFile;
+    QVector<Job>    m_jobs;
+    QHash<QString, QString> m_outputs;
+
+    void addFile(const QString &fn);
+    void addListFile(const QString &fn);
+};
+
+#endif // BATCH_H
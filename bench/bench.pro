@@ -0,0 +1,15 @@
+QT -= gui
+
+CONFIG += c++14 console count_allocs
+CONFIG -= app_bundle
+
+TARGET = dt-annotate-bench
+
+include(../annotate.pri)
+
+SOURCES += \
+        dtsgenerator.cpp \
+        main.cpp
+
+HEADERS += \
+    dtsgenerator.h
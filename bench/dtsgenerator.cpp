@@ -0,0 +1,266 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// dtsgenerator.cpp
+// generate synthetic device trees of any size for benchmarks
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "dtsgenerator.h"
+
+namespace {
+
+const char *singleHandles[] = { "vin-supply", "interrupt-parent", "rockchip,grf", "phy-supply", "memory-region", "iommus" };
+const char *gpioHandles[] = { "gpios", "reset-gpios", "snps,reset-gpio", "vsel-gpios", "ep-gpios" };
+const char *listHandles[] = { "pinctrl-0", "pinctrl-1", "phys", "nvmem-cells" };
+const char *clockNames[] = { "clocks", "dmas", "assigned-clocks" };
+const uchar irqTypes[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x08 };
+
+template <typename T, int N>
+const T &pick(const T (&a)[N], int i)
+{
+    return a[i % N];
+}
+
+} // namespace
+
+DtsGenerator::DtsGenerator()
+    : m_symbolBytes(0)
+    , m_handle(0)
+    , m_nodes(0)
+    , m_lines(0)
+{
+}
+
+DtsGenerator::Params DtsGenerator::defaults()
+{
+    Params p;
+    p.size = 1024*1024;
+    p.depth = 6;
+    p.props = 5;
+    p.phandles = 0.6;
+    p.symbols = 0.8;
+    p.gpios = 1;
+    p.clocks = 1;
+    p.interrupts = 1;
+    p.interruptMap = 1;
+    p.pins = 1;
+    p.other = 5;
+    p.seed = 1;
+    return p;
+}
+
+QByteArray DtsGenerator::generate(const Params &params)
+{
+    m_p = params;
+    m_rnd.seed(m_p.seed);
+    m_out.clear();
+    m_out.reserve(static_cast<int>(qMin<qint64>(m_p.size + m_p.size/8, 0x7fffffff)));
+    m_labels.clear();
+    m_symbolBytes = 0;
+    m_handle = 0;
+    m_nodes = 0;
+    m_lines = 0;
+
+    line(0, "/dts-v1/;");
+    line(0, "");
+    line(0, "/memreserve/\t0x0000000000000000 0x0000000000010000;");
+    line(0, "/ {");
+    line(1, "compatible = \"rockchip,rk3399\";");
+    line(1, "interrupt-parent = <0x01>;");
+    line(1, "#address-cells = <0x02>;");
+    while (!full()) {
+        QByteArray name = "top" + QByteArray::number(m_nodes + 1) + "@" + QByteArray::number(random(0, 0xffff), 16);
+        node("/" + name, name, 0);
+    }
+    line(0, "");
+    line(1, "__symbols__ {");
+    for (const auto &l : qAsConst(m_labels)) {
+        m_out += "\t\t" + l.first + " = \"" + l.second + "\";\n";
+        ++m_lines;
+    }
+    line(1, "};");
+    // dtc ends the file with a newline
+    m_out += "};\n";
+    ++m_lines;
+    return m_out;
+}
+
+int DtsGenerator::random(int lo, int hi)
+{
+    return std::uniform_int_distribution<int>(lo, hi)(m_rnd);
+}
+
+bool DtsGenerator::chance(double p)
+{
+    return std::uniform_real_distribution<double>(0.0, 1.0)(m_rnd) < p;
+}
+
+bool DtsGenerator::full() const
+{
+    return m_out.size() + m_symbolBytes >= m_p.size;
+}
+
+void DtsGenerator::node(const QByteArray &path, const QByteArray &name, int depth)
+{
+    ++m_nodes;
+    m_out.append(depth+1, '\t');
+    m_out += name + " {\n";
+    ++m_lines;
+    int n = random(0, m_p.props);
+    for (int i=0; i<n; ++i)
+        property(depth+2);
+    if (chance(m_p.phandles)) {
+        ++m_handle;
+        if (chance(m_p.symbols)) {
+            QByteArray label = "lbl_" + QByteArray::number(m_handle);
+            m_labels.append(qMakePair(label, path));
+            m_symbolBytes += label.size() + path.size() + 8;
+        }
+        m_out.append(depth+2, '\t');
+        m_out += "phandle = <";
+        hex(m_handle);
+        m_out += ">;\n";
+        ++m_lines;
+    }
+    if (depth < m_p.depth) {
+        n = random(0, (depth < 2) ? 4 : 2);
+        for (int i=0; (i<n) && !full(); ++i) {
+            QByteArray child = "node" + QByteArray::number(m_nodes + 1) + "@" + QByteArray::number(random(0, 0xffff), 16);
+            node(path + "/" + child, child, depth+1);
+        }
+    }
+    m_out.append(depth+1, '\t');
+    m_out += "};\n";
+    ++m_lines;
+}
+
+void DtsGenerator::property(int indent)
+{
+    int total = m_p.gpios + m_p.clocks + m_p.interrupts + m_p.interruptMap + m_p.pins + m_p.other;
+    if (total <= 0)
+        return;
+    int k = random(0, total-1);
+    m_out.append(indent, '\t');
+    if ((k -= m_p.gpios) < 0) {
+        m_out += pick(gpioHandles, random(0, 100));
+        m_out += " = <";
+        ref();
+        m_out += ' ';
+        hex(random(0, 31));
+        m_out += ' ';
+        hex(random(0, 1));
+    } else if ((k -= m_p.clocks) < 0) {
+        m_out += pick(clockNames, random(0, 2));
+        m_out += " = <";
+        int n = random(1, 4);
+        for (int i=0; i<n; ++i) {
+            if (i)
+                m_out += ' ';
+            ref();
+            m_out += ' ';
+            hex(random(0, 400));
+        }
+    } else if ((k -= m_p.interrupts) < 0) {
+        m_out += "interrupts = <";
+        int n = random(1, 3);
+        for (int i=0; i<n; ++i) {
+            if (i)
+                m_out += ' ';
+            hex(random(0, 1));
+            m_out += ' ';
+            hex(random(0, 200));
+            m_out += ' ';
+            hex(irqTypes[random(0, 5)]);
+            m_out += ' ';
+            hex(0);
+        }
+    } else if ((k -= m_p.interruptMap) < 0) {
+        m_out += "interrupt-map = <";
+        int n = random(1, 4);
+        for (int i=0; i<n; ++i) {
+            if (i)
+                m_out += ' ';
+            for (int j=0; j<4; ++j) {
+                hex(random(0, 9));
+                m_out += ' ';
+            }
+            ref();
+            m_out += ' ';
+            hex(random(0, 9));
+        }
+    } else if ((k -= m_p.pins) < 0) {
+        m_out += "rockchip,pins = <";
+        hex(random(0, 4));
+        m_out += ' ';
+        hex(random(0, 31));
+        m_out += ' ';
+        hex(random(0, 4));
+        m_out += ' ';
+        ref();
+    } else {
+        switch (random(0, 6)) {
+        case 0:
+            m_out += pick(singleHandles, random(0, 100));
+            m_out += " = <";
+            ref();
+            break;
+        case 1:
+            m_out += pick(listHandles, random(0, 100));
+            m_out += " = <";
+            ref();
+            m_out += ' ';
+            ref();
+            break;
+        case 2:
+            m_out += "reg = <0x00 ";
+            hex(random(0, 0xffffff));
+            m_out += " 0x00 0x1000";
+            break;
+        case 3:
+            m_out += "compatible = \"rockchip,rk3399-" + QByteArray::number(random(0, 9)) + "\\0generic\";\n";
+            ++m_lines;
+            return;
+        case 4:
+            m_out += "status = \"okay\";\n";
+            ++m_lines;
+            return;
+        case 5:
+            m_out += "dma-coherent;\n";
+            ++m_lines;
+            return;
+        default:
+            m_out += "clock-frequency = <";
+            hex(random(0, 100000000));
+            break;
+        }
+    }
+    m_out += ">;\n";
+    ++m_lines;
+}
+
+void DtsGenerator::hex(quint32 v)
+{
+    // same as dtc, at least two digits
+    m_out += "0x";
+    if (v < 16)
+        m_out += '0';
+    m_out += QByteArray::number(v, 16);
+}
+
+void DtsGenerator::ref()
+{
+    // mostly existing phandles, some of them without a node
+    hex(static_cast<quint32>(random(1, static_cast<int>(m_handle) + 3)));
+}
+
+void DtsGenerator::line(int indent, const char *text)
+{
+    m_out.append(indent, '\t');
+    m_out += text;
+    m_out += '\n';
+    ++m_lines;
+}
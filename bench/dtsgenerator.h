@@ -0,0 +1,69 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// dtsgenerator.h
+// header file for dtsgenerator.cpp
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef DTSGENERATOR_H
+#define DTSGENERATOR_H
+
+#include <QByteArray>
+#include <QPair>
+#include <QVector>
+#include <random>
+
+// synthetic device tree source in the format of "dtc -I dtb -O dts -s -@"
+class DtsGenerator
+{
+public:
+    typedef struct {
+        qint64  size;           // approximate size of the source in bytes
+        int     depth;          // maximum nesting depth of the nodes
+        int     props;          // maximum number of properties per node
+        double  phandles;       // share of nodes with a phandle
+        double  symbols;        // share of phandle nodes with a label
+        int     gpios;          // relative weights of the property kinds
+        int     clocks;
+        int     interrupts;
+        int     interruptMap;
+        int     pins;
+        int     other;
+        quint32 seed;
+    } Params;
+
+    DtsGenerator();
+
+    static Params defaults();
+    QByteArray generate(const Params &params);
+    // statistics of the last generated source
+    int lines() const { return m_lines; }
+    int nodes() const { return m_nodes; }
+    int handles() const { return static_cast<int>(m_handle); }
+    int symbols() const { return m_labels.size(); }
+
+private:
+    std::mt19937        m_rnd;
+    Params              m_p;
+    QByteArray          m_out;
+    QVector<QPair<QByteArray, QByteArray> > m_labels;   // label and path
+    qint64              m_symbolBytes;
+    quint32             m_handle;
+    int                 m_nodes;
+    int                 m_lines;
+
+    int random(int lo, int hi);
+    bool chance(double p);
+    bool full() const;
+    void node(const QByteArray &path, const QByteArray &name, int depth);
+    void property(int indent);
+    void hex(quint32 v);
+    void ref();
+    void line(int indent, const char *text);
+};
+
+#endif // DTSGENERATOR_H
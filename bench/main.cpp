@@ -0,0 +1,191 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// benchmark entry point
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "alloccounter.h"
+#include "annotate.h"
+#include "dtsgenerator.h"
+#include "lineclassifier.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QDebug>
+
+namespace {
+
+// "100K", "10M" or "1G" in bytes, 0 if invalid
+qint64 parseSize(QString s)
+{
+    qint64 factor = 1;
+    if (s.endsWith('K', Qt::CaseInsensitive))
+        factor = 1000;
+    else if (s.endsWith('M', Qt::CaseInsensitive))
+        factor = 1000*1000;
+    else if (s.endsWith('G', Qt::CaseInsensitive))
+        factor = 1000*1000*1000;
+    if (factor > 1)
+        s.chop(1);
+    bool ok;
+    double v = s.toDouble(&ok);
+    return ok ? static_cast<qint64>(v * factor) : 0;
+}
+
+QString rate(double amount, qint64 ns, int decimals)
+{
+    if (ns <= 0)
+        return "-";
+    return QString::number(amount * 1e9 / ns, 'f', decimals);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("dt-annotate-bench");
+    QCoreApplication::setApplicationVersion("1.0.2 ");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Benchmark dt-annotate with synthetic device trees");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    QCommandLineOption sizes(QStringList() << "s" << "sizes", "comma separated source sizes, suffix K, M or G", "list", "100K,1M,10M,100M,500M");
+    parser.addOption(sizes);
+    QCommandLineOption repeat(QStringList() << "r" << "repeat", "runs per size, the fastest run counts", "n", "3");
+    parser.addOption(repeat);
+    QCommandLineOption threads(QStringList() << "t" << "threads", "threads to annotate a file, 0 for one per core", "n", "1");
+    parser.addOption(threads);
+    QCommandLineOption depth("depth", "maximum nesting depth of the nodes", "n", "6");
+    parser.addOption(depth);
+    QCommandLineOption props("props", "maximum number of properties per node", "n", "5");
+    parser.addOption(props);
+    QCommandLineOption phandles("phandles", "share of nodes with a phandle", "0..1", "0.6");
+    parser.addOption(phandles);
+    QCommandLineOption symbols("symbols", "share of phandle nodes with a label in __symbols__", "0..1", "0.8");
+    parser.addOption(symbols);
+    QCommandLineOption mix("mix", "property mix as weights of gpios, clocks, interrupts, interrupt-map, rockchip,pins and other properties", "list", "1,1,1,1,1,5");
+    parser.addOption(mix);
+    QCommandLineOption seed("seed", "seed of the generator", "n", "1");
+    parser.addOption(seed);
+    QCommandLineOption keep(QStringList() << "k" << "keep", "keep the generated files in this directory", "dir");
+    parser.addOption(keep);
+    parser.process(a);
+
+    DtsGenerator::Params p = DtsGenerator::defaults();
+    p.depth = parser.value(depth).toInt();
+    p.props = parser.value(props).toInt();
+    p.phandles = parser.value(phandles).toDouble();
+    p.symbols = parser.value(symbols).toDouble();
+    p.seed = parser.value(seed).toUInt();
+    const QStringList weights = parser.value(mix).split(',');
+    if (weights.size() != 6) {
+        qCritical() << "--mix needs six weights";
+        return -2;
+    }
+    p.gpios = weights[0].toInt();
+    p.clocks = weights[1].toInt();
+    p.interrupts = weights[2].toInt();
+    p.interruptMap = weights[3].toInt();
+    p.pins = weights[4].toInt();
+    p.other = weights[5].toInt();
+    int runs = qMax(1, parser.value(repeat).toInt());
+
+    QTemporaryDir tmp;
+    QString dir = parser.isSet(keep) ? parser.value(keep) : tmp.path();
+
+    QTextStream out(stdout);
+    out << "line classifier: " << LineClassifier::kernel() << "\n";
+    const QStringList sl = parser.value(sizes).split(',');
+    for (const auto &s : sl) {
+        p.size = parseSize(s);
+        if (p.size <= 0) {
+            qCritical().noquote() << "invalid size" << s;
+            return -2;
+        }
+        DtsGenerator gen;
+        QString fnIn = dir + "/bench-" + s + ".dts";
+        QString fnOut = fnIn + ".annotated";
+        {
+            QByteArray dts = gen.generate(p);
+            QFile f(fnIn);
+            if (!f.open(QFile::Truncate | QIODevice::WriteOnly) || (f.write(dts) != dts.size())) {
+                qCritical().noquote() << "cannot write" << fnIn;
+                return -1;
+            }
+            p.size = dts.size();
+        }
+        double mb = p.size / 1e6;
+        out << QString("%1: %2 MB, %3 lines, %4 nodes, %5 phandles, %6 symbols\n")
+               .arg(s).arg(mb, 0, 'f', 1).arg(gen.lines()).arg(gen.nodes()).arg(gen.handles()).arg(gen.symbols());
+
+        // the fastest run of every stage and of the whole file, the
+        // allocations of the last run
+        qint64 best[Annotate::StageCount];
+        qint64 allocs[Annotate::StageCount];
+        qint64 propertyAllocs = 0;
+        qint64 nodeAllocs = 0;
+        qint64 bestTotal = 0;
+        for (auto &b : best)
+            b = 0;
+        for (int r=0; r<runs; ++r) {
+            Annotate annotator(true);
+            annotator.setThreads(parser.value(threads).toInt());
+            QElapsedTimer timer;
+            timer.start();
+            if (!annotator.process(fnIn, fnOut)) {
+                qCritical().noquote() << fnIn + ": " + annotator.errString();
+                return -1;
+            }
+            qint64 total = timer.nsecsElapsed();
+            if ((r == 0) || (total < bestTotal))
+                bestTotal = total;
+            for (int i=0; i<Annotate::StageCount; ++i) {
+                qint64 t = annotator.stageTime(static_cast<Annotate::Stage>(i));
+                if ((r == 0) || (t < best[i]))
+                    best[i] = t;
+                allocs[i] = annotator.statistics().allocations[i];
+            }
+            propertyAllocs = annotator.statistics().propertyAllocations;
+            nodeAllocs = annotator.statistics().nodeAllocations;
+        }
+        out << QString("  %1 %2 %3 %4").arg("stage", -10).arg("ms", 10).arg("MB/s", 10).arg("lines/s", 14);
+        if (AllocCounter::enabled())
+            out << QString(" %1 %2").arg("allocs", 12).arg("allocs/line", 12);
+        out << "\n";
+        for (int i=0; i<Annotate::StageCount; ++i) {
+            out << QString("  %1 %2 %3 %4").arg(Annotate::stageName(static_cast<Annotate::Stage>(i)), -10).arg(best[i] / 1e6, 10, 'f', 2)
+                   .arg(rate(mb, best[i], 1), 10).arg(rate(gen.lines(), best[i], 0), 14);
+            if (AllocCounter::enabled())
+                out << QString(" %1 %2").arg(allocs[i], 12).arg(double(allocs[i]) / gen.lines(), 12, 'f', 3);
+            out << "\n";
+        }
+        out << QString("  %1 %2 %3 %4\n").arg("process", -10).arg(bestTotal / 1e6, 10, 'f', 2)
+               .arg(rate(mb, bestTotal, 1), 10).arg(rate(gen.lines(), bestTotal, 0), 14);
+        out.flush();
+        // the generated trees have no fixups, so not a single property line
+        // and no node line but for new nodes may take memory from the heap
+        if (AllocCounter::enabled()) {
+            out << QString("  %1 allocations in property lines, %2 in node lines\n").arg(propertyAllocs).arg(nodeAllocs);
+            out.flush();
+            if ((propertyAllocs > 0) || (nodeAllocs > 0)) {
+                qCritical().noquote() << QString("%1: property or node lines allocated memory").arg(s);
+                return -1;
+            }
+        }
+        if (!parser.isSet(keep)) {
+            QFile::remove(fnIn);
+            QFile::remove(fnOut);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// celllist.cpp
+// decode the cell list of a property value in one pass
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "celllist.h"
+#include <ctype.h>
+#include <string.h>
+
+namespace {
+
+// value of a hex digit, 0x10 for any other character
+struct NibbleTable {
+    uchar v[256];
+    NibbleTable() {
+        memset(v, 0x10, sizeof(v));
+        for (int i=0; i<10; ++i)
+            v['0'+i] = static_cast<uchar>(i);
+        for (int i=0; i<6; ++i) {
+            v['a'+i] = static_cast<uchar>(10+i);
+            v['A'+i] = static_cast<uchar>(10+i);
+        }
+    }
+};
+const NibbleTable nibbles;
+
+// "00" to "99", two digits per division
+const char digitPairs[] =
+    "00010203040506070809" "10111213141516171819" "20212223242526272829" "30313233343536373839"
+    "40414243444546474849" "50515253545556575859" "60616263646566676869" "70717273747576777879"
+    "80818283848586878889" "90919293949596979899";
+
+} // namespace
+
+const Cell CellList::m_empty = { "", 0, 0, false, false };
+
+CellList::CellList(const QByteArray &line, const LineInfo &info, Arena *arena)
+    : m_name(line.constData())
+    , m_nameLen(0)
+    , m_text(line.constData())
+    , m_len(0)
+    , m_cells(nullptr)
+    , m_size(0)
+{
+    if (info.eq >= 0) {
+        // the trimmed name left of the '='
+        int from = 0;
+        int to = info.eq;
+        while ((from < to) && isspace(static_cast<uchar>(line.at(from))))
+            ++from;
+        while ((to > from) && isspace(static_cast<uchar>(line.at(to-1))))
+            --to;
+        m_name = line.constData() + from;
+        m_nameLen = to - from;
+        m_text = line.constData() + parameters(line, info, &m_len);
+    }
+    // every blank starts a new cell, like QByteArray::split(' ')
+    m_cells = arena->allocate<Cell>(m_len + 1);
+    const char *p = m_text;
+    const char *end = m_text + m_len;
+    for (;;) {
+        const char *e = static_cast<const char*>(memchr(p, ' ', end - p));
+        if (!e)
+            e = end;
+        decode(p, static_cast<int>(e - p), &m_cells[m_size++]);
+        if (e == end)
+            break;
+        p = e + 1;
+    }
+}
+
+int CellList::parameters(const QByteArray &line, const LineInfo &info, int *len)
+{
+    // the trimmed value up to a second '=', without "<" and ">;"
+    *len = 0;
+    if (info.eq < 0)
+        return 0;
+    int from = info.eq + 1;
+    int to = info.valueEnd;
+    while ((from < to) && isspace(static_cast<uchar>(line.at(from))))
+        ++from;
+    while ((to > from) && isspace(static_cast<uchar>(line.at(to-1))))
+        --to;
+    int n = to - from;
+    if (n <= 0)
+        return 0;
+    *len = (n >= 3) ? n - 3 : n - 1;
+    return from + 1;
+}
+
+void CellList::decode(const char *p, int len, Cell *c)
+{
+    c->text = p;
+    c->len = len;
+    // dtc writes every cell as "0x" and up to eight hex digits
+    if ((len >= 3) && (len <= 10) && (p[0] == '0') && (p[1] == 'x')) {
+        quint32 v = 0;
+        uchar invalid = 0;
+        for (int i=2; i<len; ++i) {
+            uchar d = nibbles.v[static_cast<uchar>(p[i])];
+            invalid |= d;
+            v = (v << 4) | (d & 0x0f);
+        }
+        if (!(invalid & 0x10)) {
+            c->value = v;
+            c->ok = true;
+            c->prefixed = true;
+            return;
+        }
+    }
+    // anything else is left to Qt, so octal, decimal and invalid cells
+    // keep the exact conversion rules
+    const QByteArray s = QByteArray::fromRawData(p, len);
+    c->value = s.toUInt(&c->ok, 0);
+    if (!c->ok)
+        c->value = 0;
+    c->prefixed = s.contains("0x");
+}
+
+void CellList::appendNumber(QByteArray *out, quint32 v)
+{
+    char buf[10];
+    char *p = buf + sizeof(buf);
+    while (v >= 100) {
+        p -= 2;
+        memcpy(p, digitPairs + 2*(v % 100), 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, digitPairs + 2*v, 2);
+    } else {
+        *--p = static_cast<char>('0' + v);
+    }
+    out->append(p, static_cast<int>(buf + sizeof(buf) - p));
+}
@@ -0,0 +1,62 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// celllist.h
+// header file for celllist.cpp
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef CELLLIST_H
+#define CELLLIST_H
+
+#include <QByteArray>
+#include "arena.h"
+#include "lineclassifier.h"
+
+// one cell of a property value, the text references the source line
+typedef struct {
+    const char *text;
+    int         len;
+    quint32     value;      // as QByteArray::toUInt(&ok, 0), 0 if not ok
+    bool        ok;
+    bool        prefixed;   // the text contains "0x"
+} Cell;
+
+// the cells of a value like "<0x01 0x1a 0x04>;", split at every blank like
+// QByteArray::split(' ') and decoded in a single pass without copies.
+// The cells are kept in the arena until it is reset
+class CellList
+{
+public:
+    CellList(const QByteArray &line, const LineInfo &info, Arena *arena);
+
+    int size() const { return m_size; }
+    // an empty cell beyond the end
+    const Cell &operator[](int inx) const { return (inx < m_size) ? m_cells[inx] : m_empty; }
+    // the whole parameter text
+    const char *text() const { return m_text; }
+    int length() const { return m_len; }
+    // name of the property
+    QByteArray property() const { return QByteArray::fromRawData(m_name, m_nameLen); }
+
+    // decimal number without a temporary string
+    static void appendNumber(QByteArray *out, quint32 v);
+    // offset and length of the parameter text of a line
+    static int parameters(const QByteArray &line, const LineInfo &info, int *len);
+    // a single cell, with the conversion rules of QByteArray::toUInt(&ok, 0)
+    static void decode(const char *p, int len, Cell *c);
+
+private:
+    const char     *m_name;
+    int             m_nameLen;
+    const char     *m_text;
+    int             m_len;
+    Cell           *m_cells;
+    int             m_size;
+    static const Cell m_empty;
+};
+
+#endif // CELLLIST_H
@@ -0,0 +1,619 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// compressedstream.cpp
+// read and write compressed device trees on threads of their own
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "compressedstream.h"
+#include <QScopedPointer>
+#include <string.h>
+#include <zlib.h>
+#ifdef DT_ANNOTATE_XZ
+#include <lzma.h>
+#endif
+#ifdef DT_ANNOTATE_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+
+// one direction of one format, fed with input and output space until it
+// reports the end of the data
+class Codec
+{
+public:
+    typedef enum {
+        More,           // needs more input or output space
+        End,
+        Failed
+    } Result;
+
+    virtual ~Codec() {}
+    // consumes input and fills the output, the pointers and sizes are
+    // advanced. finish: no more input follows
+    virtual Result run(const char **in, size_t *inLeft, char **out, size_t *outLeft, bool finish) = 0;
+};
+
+class GzipDecoder : public Codec
+{
+public:
+    GzipDecoder() : m_idle(true), m_padding(false) {
+        memset(&m_z, 0, sizeof(m_z));
+        m_ok = (inflateInit2(&m_z, 15 + 32) == Z_OK);
+    }
+    ~GzipDecoder() override { inflateEnd(&m_z); }
+    Result run(const char **in, size_t *inLeft, char **out, size_t *outLeft, bool finish) override {
+        if (!m_ok)
+            return Failed;
+        // a member starts with 0x1f, a zero byte in its place starts the
+        // padding that tar and dd may leave after the last member
+        if (m_idle && (*inLeft > 0) && (**in == 0))
+            m_padding = true;
+        if (m_padding) {
+            while ((*inLeft > 0) && (**in == 0)) {
+                ++*in;
+                --*inLeft;
+            }
+            if (*inLeft > 0)
+                return Failed;
+            return finish ? End : More;
+        }
+        m_z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(*in));
+        m_z.avail_in = static_cast<uInt>(*inLeft);
+        m_z.next_out = reinterpret_cast<Bytef*>(*out);
+        m_z.avail_out = static_cast<uInt>(*outLeft);
+        int ret = inflate(&m_z, Z_NO_FLUSH);
+        if (m_z.avail_in != *inLeft)
+            m_idle = false;
+        *in = reinterpret_cast<const char*>(m_z.next_in);
+        *inLeft = m_z.avail_in;
+        *out = reinterpret_cast<char*>(m_z.next_out);
+        *outLeft = m_z.avail_out;
+        switch (ret) {
+        case Z_STREAM_END:
+            if (finish && (*inLeft == 0))
+                return End;
+            // gzip files may be concatenated
+            inflateReset(&m_z);
+            m_idle = true;
+            return More;
+        case Z_OK:
+            return More;
+        case Z_BUF_ERROR:
+            if (finish && (*inLeft == 0))
+                return m_idle ? End : Failed;
+            return More;
+        default:
+            return Failed;
+        }
+    }
+
+private:
+    z_stream    m_z;
+    bool        m_ok;
+    bool        m_idle;     // nothing of the current member read yet
+    bool        m_padding;  // only zero bytes may follow
+};
+
+class GzipEncoder : public Codec
+{
+public:
+    GzipEncoder() {
+        memset(&m_z, 0, sizeof(m_z));
+        m_ok = (deflateInit2(&m_z, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    }
+    ~GzipEncoder() override { deflateEnd(&m_z); }
+    Result run(const char **in, size_t *inLeft, char **out, size_t *outLeft, bool finish) override {
+        if (!m_ok)
+            return Failed;
+        m_z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(*in));
+        m_z.avail_in = static_cast<uInt>(*inLeft);
+        m_z.next_out = reinterpret_cast<Bytef*>(*out);
+        m_z.avail_out = static_cast<uInt>(*outLeft);
+        int ret = deflate(&m_z, finish ? Z_FINISH : Z_NO_FLUSH);
+        *in = reinterpret_cast<const char*>(m_z.next_in);
+        *inLeft = m_z.avail_in;
+        *out = reinterpret_cast<char*>(m_z.next_out);
+        *outLeft = m_z.avail_out;
+        if (ret == Z_STREAM_END)
+            return End;
+        return ((ret == Z_OK) || (ret == Z_BUF_ERROR)) ? More : Failed;
+    }
+
+private:
+    z_stream    m_z;
+    bool        m_ok;
+};
+
+#ifdef DT_ANNOTATE_XZ
+class XzCodec : public Codec
+{
+public:
+    explicit XzCodec(bool encode) {
+        lzma_stream init = LZMA_STREAM_INIT;
+        m_s = init;
+        if (encode)
+            m_ok = (lzma_easy_encoder(&m_s, 6, LZMA_CHECK_CRC64) == LZMA_OK);
+        else
+            m_ok = (lzma_stream_decoder(&m_s, UINT64_MAX, LZMA_CONCATENATED) == LZMA_OK);
+    }
+    ~XzCodec() override { lzma_end(&m_s); }
+    Result run(const char **in, size_t *inLeft, char **out, size_t *outLeft, bool finish) override {
+        if (!m_ok)
+            return Failed;
+        m_s.next_in = reinterpret_cast<const uint8_t*>(*in);
+        m_s.avail_in = *inLeft;
+        m_s.next_out = reinterpret_cast<uint8_t*>(*out);
+        m_s.avail_out = *outLeft;
+        lzma_ret ret = lzma_code(&m_s, finish ? LZMA_FINISH : LZMA_RUN);
+        *in = reinterpret_cast<const char*>(m_s.next_in);
+        *inLeft = m_s.avail_in;
+        *out = reinterpret_cast<char*>(m_s.next_out);
+        *outLeft = m_s.avail_out;
+        if (ret == LZMA_STREAM_END)
+            return End;
+        if ((ret == LZMA_OK) || ((ret == LZMA_BUF_ERROR) && !finish))
+            return More;
+        return Failed;
+    }
+
+private:
+    lzma_stream m_s;
+    bool        m_ok;
+};
+#endif
+
+#ifdef DT_ANNOTATE_ZSTD
+class ZstdDecoder : public Codec
+{
+public:
+    ZstdDecoder() : m_ds(ZSTD_createDStream()), m_pending(0) {}
+    ~ZstdDecoder() override { ZSTD_freeDStream(m_ds); }
+    Result run(const char **in, size_t *inLeft, char **out, size_t *outLeft, bool finish) override {
+        if (!m_ds)
+            return Failed;
+        ZSTD_inBuffer ib = { *in, *inLeft, 0 };
+        ZSTD_outBuffer ob = { *out, *outLeft, 0 };
+        size_t ret = ZSTD_decompressStream(m_ds, &ob, &ib);
+        if (ZSTD_isError(ret))
+            return Failed;
+        // 0 at the end of a frame, frames may be concatenated
+        if (ib.pos || ob.pos)
+            m_pending = ret;
+        *in += ib.pos;
+        *inLeft -= ib.pos;
+        *out += ob.pos;
+        *outLeft -= ob.pos;
+        if (finish && (*inLeft == 0) && (ob.pos < ob.size))
+            return (m_pending == 0) ? End : Failed;
+        return More;
+    }
+
+private:
+    ZSTD_DStream   *m_ds;
+    size_t          m_pending;
+};
+
+class ZstdEncoder : public Codec
+{
+public:
+    ZstdEncoder() : m_cs(ZSTD_createCCtx()) {}
+    ~ZstdEncoder() override { ZSTD_freeCCtx(m_cs); }
+    Result run(const char **in, size_t *inLeft, char **out, size_t *outLeft, bool finish) override {
+        if (!m_cs)
+            return Failed;
+        ZSTD_inBuffer ib = { *in, *inLeft, 0 };
+        ZSTD_outBuffer ob = { *out, *outLeft, 0 };
+        size_t ret = ZSTD_compressStream2(m_cs, &ob, &ib, finish ? ZSTD_e_end : ZSTD_e_continue);
+        if (ZSTD_isError(ret))
+            return Failed;
+        *in += ib.pos;
+        *inLeft -= ib.pos;
+        *out += ob.pos;
+        *outLeft -= ob.pos;
+        return (finish && (ret == 0)) ? End : More;
+    }
+
+private:
+    ZSTD_CCtx      *m_cs;
+};
+#endif
+
+Codec *createCodec(Compression::Format f, bool encode)
+{
+    switch (f) {
+    case Compression::Gzip:
+        if (encode)
+            return new GzipEncoder;
+        return new GzipDecoder;
+#ifdef DT_ANNOTATE_XZ
+    case Compression::Xz:
+        return new XzCodec(encode);
+#endif
+#ifdef DT_ANNOTATE_ZSTD
+    case Compression::Zstd:
+        if (encode)
+            return new ZstdEncoder;
+        return new ZstdDecoder;
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+// enough to tell the formats apart
+const int magicSize = 6;
+
+} // namespace
+
+Compression::Format Compression::fromFileName(const QString &fn)
+{
+    if (fn.endsWith(".gz"))
+        return Gzip;
+    if (fn.endsWith(".xz"))
+        return Xz;
+    if (fn.endsWith(".zst"))
+        return Zstd;
+    return None;
+}
+
+Compression::Format Compression::fromData(const char *data, int size)
+{
+    const uchar *d = reinterpret_cast<const uchar*>(data);
+    if ((size >= 2) && (d[0] == 0x1f) && (d[1] == 0x8b))
+        return Gzip;
+    if ((size >= 6) && !memcmp(d, "\xfd" "7zXZ\0", 6))
+        return Xz;
+    if ((size >= 4) && (d[0] == 0x28) && (d[1] == 0xb5) && (d[2] == 0x2f) && (d[3] == 0xfd))
+        return Zstd;
+    return None;
+}
+
+bool Compression::isSupported(Format f)
+{
+    switch (f) {
+    case None:
+    case Gzip:
+        return true;
+    case Xz:
+#ifdef DT_ANNOTATE_XZ
+        return true;
+#else
+        return false;
+#endif
+    case Zstd:
+#ifdef DT_ANNOTATE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+const char *Compression::name(Format f)
+{
+    switch (f) {
+    case None: return "uncompressed";
+    case Gzip: return "gzip";
+    case Xz: return "xz";
+    case Zstd: return "zstd";
+    }
+    return "unknown";
+}
+
+QString Compression::suffix(Format f)
+{
+    switch (f) {
+    case None: return QString();
+    case Gzip: return ".gz";
+    case Xz: return ".xz";
+    case Zstd: return ".zst";
+    }
+    return QString();
+}
+
+QString Compression::annotatedName(const QString &fn)
+{
+    const QString s = suffix(fromFileName(fn));
+    return fn.left(fn.size() - s.size()) + ".annotated" + s;
+}
+
+BlockQueue::BlockQueue(int capacity)
+    : m_capacity(capacity)
+    , m_closed(false)
+    , m_aborted(false)
+{
+}
+
+bool BlockQueue::push(const QByteArray &block)
+{
+    QMutexLocker lock(&m_mutex);
+    while (!m_aborted && (m_blocks.size() >= m_capacity))
+        m_notFull.wait(&m_mutex);
+    if (m_aborted)
+        return false;
+    m_blocks.append(block);
+    m_notEmpty.wakeOne();
+    return true;
+}
+
+bool BlockQueue::pop(QByteArray *block)
+{
+    QMutexLocker lock(&m_mutex);
+    while (!m_aborted && !m_closed && m_blocks.isEmpty())
+        m_notEmpty.wait(&m_mutex);
+    if (m_aborted || m_blocks.isEmpty())
+        return false;
+    *block = m_blocks.takeFirst();
+    m_notFull.wakeOne();
+    return true;
+}
+
+void BlockQueue::close()
+{
+    QMutexLocker lock(&m_mutex);
+    m_closed = true;
+    m_notEmpty.wakeAll();
+}
+
+void BlockQueue::abort()
+{
+    QMutexLocker lock(&m_mutex);
+    m_aborted = true;
+    m_blocks.clear();
+    m_notEmpty.wakeAll();
+    m_notFull.wakeAll();
+}
+
+bool BlockQueue::isAborted()
+{
+    QMutexLocker lock(&m_mutex);
+    return m_aborted;
+}
+
+StreamInput::StreamInput(int blockSize, int queued)
+    : m_format(Compression::None)
+    , m_status(StreamOk)
+    , m_blockSize(blockSize)
+    , m_pos(0)
+    , m_compressed(0)
+    , m_queue(queued)
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+StreamInput::~StreamInput()
+{
+    m_queue.abort();
+    m_pool.waitForDone();
+}
+
+bool StreamInput::open(const QString &fn)
+{
+    bool ok;
+    if (fn == "-") {
+        ok = m_file.open(stdin, QIODevice::ReadOnly);
+    } else {
+        m_file.setFileName(fn);
+        ok = m_file.open(QIODevice::ReadOnly);
+    }
+    if (!ok) {
+        m_status = StreamOpenError;
+        return false;
+    }
+    // the first bytes tell the format, they are kept as the first block
+    m_block.resize(magicSize);
+    int used = 0;
+    while (used < magicSize) {
+        qint64 n = m_file.read(m_block.data() + used, magicSize - used);
+        if (n < 0) {
+            m_status = StreamIoError;
+            return false;
+        }
+        if (n == 0)
+            break;
+        used += static_cast<int>(n);
+    }
+    m_block.resize(used);
+    m_compressed = used;
+    m_format = Compression::fromData(m_block.constData(), m_block.size());
+    if (!Compression::isSupported(m_format)) {
+        m_status = StreamUnsupported;
+        return false;
+    }
+    if (m_format != Compression::None) {
+        // the first bytes are decompressed with the rest
+        QByteArray head = m_block;
+        m_block.clear();
+        m_pool.start([this, head]() { decompress(head); });
+    }
+    return true;
+}
+
+void StreamInput::decompress(QByteArray in)
+{
+    QScopedPointer<Codec> codec(createCodec(m_format, false));
+    const char *ip = in.constData();
+    size_t inLeft = static_cast<size_t>(in.size());
+    bool eof = false;
+    QByteArray out(m_blockSize, Qt::Uninitialized);
+    char *op = out.data();
+    size_t outLeft = static_cast<size_t>(m_blockSize);
+    for (;;) {
+        if ((inLeft == 0) && !eof) {
+            in.resize(m_blockSize);
+            qint64 n = m_file.read(in.data(), m_blockSize);
+            if (n < 0) {
+                m_status = StreamIoError;
+                break;
+            }
+            eof = (n == 0);
+            in.resize(static_cast<int>(n));
+            ip = in.constData();
+            inLeft = static_cast<size_t>(n);
+            m_compressed += n;
+        }
+        size_t before = outLeft;
+        Codec::Result r = codec->run(&ip, &inLeft, &op, &outLeft, eof);
+        if ((r == Codec::More) && eof && (inLeft == 0) && (outLeft == before)) {
+            // no progress at the end of the input
+            r = Codec::Failed;
+        }
+        if (r == Codec::Failed) {
+            m_status = StreamDataError;
+            break;
+        }
+        if ((outLeft == 0) || (r == Codec::End)) {
+            out.resize(m_blockSize - static_cast<int>(outLeft));
+            if (!out.isEmpty() && !m_queue.push(out))
+                return;
+            if (r == Codec::End)
+                break;
+            out = QByteArray(m_blockSize, Qt::Uninitialized);
+            op = out.data();
+            outLeft = static_cast<size_t>(m_blockSize);
+        }
+    }
+    m_queue.close();
+}
+
+qint64 StreamInput::read(char *data, qint64 maxSize)
+{
+    if (m_pos == m_block.size()) {
+        if (m_format == Compression::None)
+            return m_file.read(data, maxSize);
+        // the status is set before the queue is closed
+        m_pos = 0;
+        m_block.clear();
+        if (!m_queue.pop(&m_block))
+            return (m_status == StreamOk) ? 0 : -1;
+    }
+    int n = static_cast<int>(qMin<qint64>(maxSize, m_block.size() - m_pos));
+    memcpy(data, m_block.constData() + m_pos, static_cast<size_t>(n));
+    m_pos += n;
+    return n;
+}
+
+QByteArray StreamInput::readAll()
+{
+    QByteArray all;
+    QByteArray buf(m_blockSize, Qt::Uninitialized);
+    qint64 n;
+    while ((n = read(buf.data(), buf.size())) > 0)
+        all.append(buf.constData(), static_cast<int>(n));
+    return all;
+}
+
+StreamOutput::StreamOutput(int blockSize, int queued)
+    : m_device(&m_file)
+    , m_format(Compression::None)
+    , m_status(StreamOk)
+    , m_blockSize(blockSize)
+    , m_running(false)
+    , m_queue(queued)
+{
+    m_pool.setMaxThreadCount(1);
+}
+
+StreamOutput::~StreamOutput()
+{
+    // the compressing thread stops without finishing the data, the saved
+    // file is discarded unless it was committed
+    m_queue.abort();
+    m_pool.waitForDone();
+}
+
+bool StreamOutput::open(const QString &fn)
+{
+    bool ok;
+    if (fn == "-") {
+        m_device = &m_stdout;
+        ok = m_stdout.open(stdout, QIODevice::WriteOnly);
+    } else {
+        m_format = Compression::fromFileName(fn);
+        if (!Compression::isSupported(m_format)) {
+            m_status = StreamUnsupported;
+            return false;
+        }
+        m_file.setFileName(fn);
+        ok = m_file.open(QIODevice::WriteOnly);
+    }
+    if (!ok) {
+        m_status = StreamOpenError;
+        return false;
+    }
+    if (m_format != Compression::None) {
+        m_running = true;
+        m_pool.start([this]() { compress(); });
+    }
+    return true;
+}
+
+bool StreamOutput::write(const QByteArray &data)
+{
+    if (m_format == Compression::None) {
+        if ((m_status == StreamOk) && (m_device->write(data) != data.size()))
+            m_status = StreamIoError;
+        return (m_status == StreamOk);
+    }
+    // the compressing thread owns the block from now on, it aborts the
+    // queue on errors
+    return data.isEmpty() || m_queue.push(data);
+}
+
+bool StreamOutput::close()
+{
+    if (m_running) {
+        m_queue.close();
+        m_pool.waitForDone();
+        m_running = false;
+    }
+    if ((m_status == StreamOk) && !m_device->flush())
+        m_status = StreamIoError;
+    if (m_device == &m_file) {
+        if (m_status != StreamOk)
+            m_file.cancelWriting();
+        if (!m_file.commit() && (m_status == StreamOk))
+            m_status = StreamIoError;
+    }
+    return (m_status == StreamOk);
+}
+
+void StreamOutput::compress()
+{
+    QScopedPointer<Codec> codec(createCodec(m_format, true));
+    QByteArray out(m_blockSize, Qt::Uninitialized);
+    QByteArray in;
+    bool finish = false;
+    while (!finish) {
+        finish = !m_queue.pop(&in);
+        if (finish) {
+            // an aborted stream is left unfinished, it is never committed
+            if (m_queue.isAborted())
+                return;
+            in.clear();
+        }
+        const char *ip = in.constData();
+        size_t inLeft = static_cast<size_t>(in.size());
+        Codec::Result r;
+        do {
+            char *op = out.data();
+            size_t outLeft = static_cast<size_t>(out.size());
+            r = codec->run(&ip, &inLeft, &op, &outLeft, finish);
+            int n = out.size() - static_cast<int>(outLeft);
+            if ((r == Codec::Failed) || ((n > 0) && (m_device->write(out.constData(), n) != n))) {
+                m_status = (r == Codec::Failed) ? StreamDataError : StreamIoError;
+                // the writer gives up, later blocks are dropped
+                m_queue.abort();
+                return;
+            }
+            // until the input is used up or, at the end, everything is written
+        } while (finish ? (r != Codec::End) : (inLeft > 0));
+    }
+}
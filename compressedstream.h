@@ -0,0 +1,150 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// compressedstream.h
+// header file for compressedstream.cpp
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef COMPRESSEDSTREAM_H
+#define COMPRESSEDSTREAM_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QSaveFile>
+#include <QString>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+// compression formats of device tree files. gzip is always supported, xz
+// and zstd if the libraries were found at build time (DT_ANNOTATE_XZ,
+// DT_ANNOTATE_ZSTD)
+class Compression
+{
+public:
+    typedef enum {
+        None = 0,
+        Gzip,
+        Xz,
+        Zstd
+    } Format;
+
+    // by the file name extention
+    static Format fromFileName(const QString &fn);
+    // by the magic number at the start of the data
+    static Format fromData(const char *data, int size);
+    static bool isSupported(Format f);
+    static const char *name(Format f);
+    // file name extention including the dot, empty for none
+    static QString suffix(Format f);
+    // default output file name, "board.dts.gz" gives "board.dts.annotated.gz"
+    static QString annotatedName(const QString &fn);
+};
+
+// blocks handed from one thread to another, the producer waits while the
+// queue is full
+class BlockQueue
+{
+public:
+    explicit BlockQueue(int capacity);
+
+    // false if the queue was aborted
+    bool push(const QByteArray &block);
+    // waits for the next block, false at the end or if aborted
+    bool pop(QByteArray *block);
+    // no more blocks follow
+    void close();
+    // wake up both sides and drop all blocks
+    void abort();
+    // tells an abort from the end after pop() returned false
+    bool isAborted();
+
+private:
+    QMutex          m_mutex;
+    QWaitCondition  m_notEmpty;
+    QWaitCondition  m_notFull;
+    QList<QByteArray> m_blocks;
+    int             m_capacity;
+    bool            m_closed;
+    bool            m_aborted;
+};
+
+typedef enum {
+    StreamOk = 0,
+    StreamOpenError,
+    StreamIoError,          // reading or writing the file failed
+    StreamDataError,        // corrupt or truncated compressed data
+    StreamUnsupported       // compression format not built in
+} StreamStatus;
+
+// a file or stdin, decompressed on a thread of its own while the caller
+// annotates the blocks decompressed before. Uncompressed input is read
+// directly
+class StreamInput
+{
+public:
+    StreamInput(int blockSize = 1024*1024, int queued = 4);
+    ~StreamInput();
+
+    // "-" for stdin, the format is taken from the first bytes
+    bool open(const QString &fn);
+    // like QIODevice::read(), 0 at the end and -1 on errors
+    qint64 read(char *data, qint64 maxSize);
+    QByteArray readAll();
+    Compression::Format format() const { return m_format; }
+    StreamStatus status() const { return m_status; }
+    // bytes read from the file
+    qint64 compressedBytes() const { return m_compressed; }
+
+private:
+    QFile               m_file;
+    Compression::Format m_format;
+    StreamStatus        m_status;
+    int                 m_blockSize;
+    QByteArray          m_block;        // the block being read
+    int                 m_pos;
+    qint64              m_compressed;
+    BlockQueue          m_queue;
+    QThreadPool         m_pool;
+
+    void decompress(QByteArray in);
+};
+
+// a file or stdout, compressed on a thread of its own while the caller
+// goes on with the next block. Uncompressed output is written directly.
+// A file is replaced only by a successful close(), it stays as it was if
+// writing fails or the stream is destroyed before
+class StreamOutput
+{
+public:
+    StreamOutput(int blockSize = 1024*1024, int queued = 4);
+    ~StreamOutput();
+
+    // "-" for stdout, the format is taken from the file name extention
+    bool open(const QString &fn);
+    bool write(const QByteArray &data);
+    // write everything that is still queued, false on errors
+    bool close();
+    Compression::Format format() const { return m_format; }
+    StreamStatus status() const { return m_status; }
+
+private:
+    QFile               m_stdout;
+    QSaveFile           m_file;
+    QFileDevice        *m_device;       // one of the two above
+    Compression::Format m_format;
+    StreamStatus        m_status;
+    int                 m_blockSize;
+    bool                m_running;
+    BlockQueue          m_queue;
+    QThreadPool         m_pool;
+
+    void compress();
+};
+
+#endif // COMPRESSEDSTREAM_H
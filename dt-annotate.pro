@@ -1,15 +1,20 @@
 QT -= gui
+QT += network
 
-CONFIG += c++11 console
+CONFIG += c++14 console
 CONFIG -= app_bundle
 
 # You can make your code fail to compile if it uses deprecated APIs.
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+include(annotate.pri)
+
 SOURCES += \
-        annotate.cpp \
-        main.cpp
+        batch.cpp \
+        main.cpp \
+        server.cpp \
+        treediff.cpp
 
 TRANSLATIONS += \
     dt-annotate_en_US.ts
@@ -20,4 +25,6 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
-    annotate.h
+    batch.h \
+    server.h \
+    treediff.h
@@ -0,0 +1,291 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// dtbreader.cpp
+// read a flattened device tree blob without the help of dtc
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "dtbreader.h"
+#include <QtEndian>
+#include <QPair>
+#include <string.h>
+#include <algorithm>
+
+namespace {
+
+const quint32 FDT_MAGIC      = 0xd00dfeed;
+const quint32 FDT_BEGIN_NODE = 0x1;
+const quint32 FDT_END_NODE   = 0x2;
+const quint32 FDT_PROP       = 0x3;
+const quint32 FDT_NOP        = 0x4;
+const quint32 FDT_END        = 0x9;
+const int     FDT_HEADER_SIZE = 40;
+// nodes are written recursively, real trees are less than 10 levels deep
+const int     MAX_DEPTH = 256;
+
+inline quint32 be32(const char *p)
+{
+    return qFromBigEndian<quint32>(reinterpret_cast<const uchar*>(p));
+}
+
+inline quint64 be64(const char *p)
+{
+    return qFromBigEndian<quint64>(reinterpret_cast<const uchar*>(p));
+}
+
+inline int align4(int x)
+{
+    return (x + 3) & ~3;
+}
+
+void appendHex(QByteArray *out, quint64 v, int digits)
+{
+    QByteArray x = QByteArray::number(v, 16);
+    if (x.length() < digits)
+        out->append(digits - x.length(), '0');
+    out->append(x);
+}
+
+bool isStringChar(char c)
+{
+    return ((c >= 0x20) && (c < 0x7f)) || (c == '\0') || ((c != '\0') && strchr("\a\b\t\n\v\f\r", c));
+}
+
+} // namespace
+
+DtbReader::DtbReader()
+    : m_data(nullptr)
+    , m_size(0)
+    , m_out(nullptr)
+{
+}
+
+bool DtbReader::isBlob(const char *data, int size)
+{
+    return (size >= FDT_HEADER_SIZE) && (be32(data) == FDT_MAGIC);
+}
+
+bool DtbReader::toSource(const char *data, int size, QByteArray *dts)
+{
+    if (!isBlob(data, size))
+        return false;
+    m_data = data;
+    quint32 total = be32(data + 4);
+    m_size = (total < static_cast<quint32>(size)) ? static_cast<int>(total) : size;
+    m_nodes.clear();
+    if (!parseStructure())
+        return false;
+    m_out = dts;
+    m_out->clear();
+    // a decompiled tree is roughly twice the size of the blob
+    m_out->reserve(2 * m_size);
+    *m_out += "/dts-v1/;\n\n";
+    writeReserveMap();
+    writeNode(0, 0);
+    m_out = nullptr;
+    return true;
+}
+
+bool DtbReader::parseStructure()
+{
+    quint32 version = be32(m_data + 20);
+    if (version < 16) {
+        // older versions store full paths as node names
+        return false;
+    }
+    int offStruct = static_cast<int>(be32(m_data + 8));
+    int offStrings = static_cast<int>(be32(m_data + 12));
+    int sizeStrings = static_cast<int>(be32(m_data + 32));
+    int endStruct = m_size;
+    if (version >= 17)
+        endStruct = qMin<qint64>(m_size, static_cast<qint64>(offStruct) + be32(m_data + 36));
+    if ((offStruct < FDT_HEADER_SIZE) || (offStruct >= endStruct) || (offStrings < 0)
+            || (static_cast<qint64>(offStrings) + sizeStrings > m_size))
+        return false;
+
+    QVector<int> stack;
+    int pos = offStruct;
+    while (pos + 4 <= endStruct) {
+        quint32 token = be32(m_data + pos);
+        pos += 4;
+        switch (token) {
+        case FDT_BEGIN_NODE: {
+            const char *name = m_data + pos;
+            const void *eos = memchr(name, '\0', endStruct - pos);
+            if (!eos)
+                return false;
+            pos = align4(pos + static_cast<int>(static_cast<const char*>(eos) - name) + 1);
+            if (stack.isEmpty() && !m_nodes.isEmpty()) {
+                // only one root node allowed
+                return false;
+            }
+            if (stack.size() >= MAX_DEPTH)
+                return false;
+            Node n;
+            n.name = name;
+            m_nodes.append(n);
+            int inx = m_nodes.size() - 1;
+            if (!stack.isEmpty())
+                m_nodes[stack.last()].children.append(inx);
+            stack.append(inx);
+            break;
+        }
+        case FDT_END_NODE:
+            if (stack.isEmpty())
+                return false;
+            stack.removeLast();
+            break;
+        case FDT_PROP: {
+            if (stack.isEmpty() || (pos + 8 > endStruct))
+                return false;
+            int len = static_cast<int>(be32(m_data + pos));
+            int nameOff = static_cast<int>(be32(m_data + pos + 4));
+            pos += 8;
+            if ((len < 0) || (len > endStruct - pos) || (nameOff < 0) || (nameOff >= sizeStrings))
+                return false;
+            Property p;
+            p.name = m_data + offStrings + nameOff;
+            if (!memchr(p.name, '\0', sizeStrings - nameOff))
+                return false;
+            p.value = m_data + pos;
+            p.len = len;
+            m_nodes[stack.last()].props.append(p);
+            pos = align4(pos + len);
+            break;
+        }
+        case FDT_NOP:
+            break;
+        case FDT_END:
+            return stack.isEmpty() && !m_nodes.isEmpty();
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+void DtbReader::writeReserveMap()
+{
+    typedef QPair<quint64, quint64> Range;
+    QVector<Range> ranges;
+    int pos = static_cast<int>(be32(m_data + 16));
+    if (pos < FDT_HEADER_SIZE)
+        return;
+    while (pos + 16 <= m_size) {
+        Range r(be64(m_data + pos), be64(m_data + pos + 8));
+        if ((r.first == 0) && (r.second == 0))
+            break;
+        ranges.append(r);
+        pos += 16;
+    }
+    std::sort(ranges.begin(), ranges.end());
+    for (const auto &r : qAsConst(ranges)) {
+        *m_out += "/memreserve/\t0x";
+        appendHex(m_out, r.first, 16);
+        *m_out += " 0x";
+        appendHex(m_out, r.second, 16);
+        *m_out += ";\n";
+    }
+}
+
+void DtbReader::writeNode(int inx, int level)
+{
+    Node &n = m_nodes[inx];
+    m_out->append(level, '\t');
+    if (*n.name) {
+        *m_out += n.name;
+        *m_out += " {\n";
+    } else {
+        *m_out += "/ {\n";
+    }
+    std::sort(n.props.begin(), n.props.end(), [](const Property &a, const Property &b) {
+        return strcmp(a.name, b.name) < 0;
+    });
+    for (const auto &p : qAsConst(n.props)) {
+        m_out->append(level+1, '\t');
+        *m_out += p.name;
+        writeValue(p);
+    }
+    std::sort(n.children.begin(), n.children.end(), [this](int a, int b) {
+        return strcmp(m_nodes[a].name, m_nodes[b].name) < 0;
+    });
+    for (int child : qAsConst(n.children)) {
+        *m_out += '\n';
+        writeNode(child, level+1);
+    }
+    m_out->append(level, '\t');
+    *m_out += "};\n";
+}
+
+void DtbReader::writeValue(const Property &p)
+{
+    if (p.len == 0) {
+        *m_out += ";\n";
+        return;
+    }
+    // guess the value type in the same way dtc does
+    int nNotString = 0;
+    int nNul = 0;
+    for (int i=0; i<p.len; ++i) {
+        if (!isStringChar(p.value[i]))
+            ++nNotString;
+        if (p.value[i] == '\0')
+            ++nNul;
+    }
+    if ((p.value[p.len-1] == '\0') && (nNotString == 0) && (nNul <= p.len - nNul)) {
+        *m_out += " = ";
+        writeString(p.value, p.len);
+    } else if (p.len % 4 == 0) {
+        *m_out += " = <";
+        for (int i=0; i<p.len; i+=4) {
+            if (i)
+                *m_out += ' ';
+            *m_out += "0x";
+            appendHex(m_out, be32(p.value + i), 2);
+        }
+        *m_out += '>';
+    } else {
+        *m_out += " = [";
+        for (int i=0; i<p.len; ++i) {
+            if (i)
+                *m_out += ' ';
+            appendHex(m_out, static_cast<uchar>(p.value[i]), 2);
+        }
+        *m_out += ']';
+    }
+    *m_out += ";\n";
+}
+
+void DtbReader::writeString(const char *s, int len)
+{
+    // the terminating NUL of the last string is not shown
+    const char *end = s + len - 1;
+    *m_out += '"';
+    while (s < end) {
+        char c = *s++;
+        switch (c) {
+        case '\a': *m_out += "\\a"; break;
+        case '\b': *m_out += "\\b"; break;
+        case '\t': *m_out += "\\t"; break;
+        case '\n': *m_out += "\\n"; break;
+        case '\v': *m_out += "\\v"; break;
+        case '\f': *m_out += "\\f"; break;
+        case '\r': *m_out += "\\r"; break;
+        case '\\': *m_out += "\\\\"; break;
+        case '"':  *m_out += "\\\""; break;
+        case '\0': *m_out += "\\0"; break;
+        default:
+            if ((c >= 0x20) && (c < 0x7f)) {
+                *m_out += c;
+            } else {
+                *m_out += "\\x";
+                appendHex(m_out, static_cast<uchar>(c), 2);
+            }
+        }
+    }
+    *m_out += '"';
+}
@@ -0,0 +1,54 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// dtbreader.h
+// header file for dtbreader.cpp
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef DTBREADER_H
+#define DTBREADER_H
+
+#include <QByteArray>
+#include <QVector>
+
+class DtbReader
+{
+public:
+    DtbReader();
+
+    static bool isBlob(const char *data, int size);
+
+    // decompile a flattened device tree (DTB or DTBO) to source, the output
+    // matches "dtc -I dtb -O dts -s"
+    bool toSource(const char *data, int size, QByteArray *dts);
+
+private:
+    typedef struct {
+        const char *name;
+        const char *value;
+        int         len;
+    } Property;
+
+    typedef struct {
+        const char         *name;
+        QVector<Property>   props;
+        QVector<int>        children;
+    } Node;
+
+    const char     *m_data;
+    int             m_size;
+    QVector<Node>   m_nodes;
+    QByteArray     *m_out;
+
+    bool parseStructure();
+    void writeReserveMap();
+    void writeNode(int inx, int level);
+    void writeValue(const Property &p);
+    void writeString(const char *s, int len);
+};
+
+#endif // DTBREADER_H
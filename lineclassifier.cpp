@@ -0,0 +1,281 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// lineclassifier.cpp
+// find newlines, braces, '=' and '<' of a whole buffer in one sweep
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "lineclassifier.h"
+#include <QtGlobal>
+#include <QByteArray>
+
+// the vector kernels need x86-64, where SSE2 is always present
+#if defined(Q_PROCESSOR_X86_64)
+#define LINECLASSIFIER_SIMD
+#include <immintrin.h>
+#if defined(Q_CC_MSVC)
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+typedef enum {
+    ScalarKernel = 0,
+    Sse2Kernel,
+    Avx2Kernel
+} Kernel;
+
+// the line being classified
+class Lines
+{
+public:
+    Lines(const char *data, QVector<LineInfo> *lines)
+        : m_data(data)
+        , m_lines(lines)
+    {
+        start(0);
+    }
+
+    // a character of interest at pos
+    inline void mark(int pos)
+    {
+        int rel = pos - m_cur.offset;
+        switch (m_data[pos]) {
+        case '\n':
+            end(rel);
+            start(pos + 1);
+            break;
+        case '{':
+            if (m_cur.open < 0)
+                m_cur.open = rel;
+            break;
+        case '}':
+            if (m_cur.close < 0)
+                m_cur.close = rel;
+            break;
+        case '=':
+            if (m_cur.eq < 0)
+                m_cur.eq = rel;
+            else if (m_cur.valueEnd < 0)
+                m_cur.valueEnd = rel;
+            break;
+        case '<':
+            if (m_cur.lt < 0)
+                m_cur.lt = rel;
+            break;
+        }
+    }
+
+    // 64 characters at pos, one bit per character of each kind. The bits
+    // of a line are handled together, up to the next newline
+    inline void block(int pos, quint64 nl, quint64 open, quint64 close, quint64 eq, quint64 lt)
+    {
+        for (;;) {
+            // all bits up to and including the next newline
+            quint64 line = nl ? (nl ^ (nl - 1)) : ~0ULL;
+            first(&m_cur.open, pos, open & line);
+            first(&m_cur.close, pos, close & line);
+            first(&m_cur.lt, pos, lt & line);
+            quint64 e = eq & line;
+            if (e && (m_cur.eq < 0)) {
+                m_cur.eq = pos + lowest(e) - m_cur.offset;
+                e &= e - 1;
+            }
+            first(&m_cur.valueEnd, pos, e);
+            if (!nl)
+                break;
+            open &= ~line;
+            close &= ~line;
+            eq &= ~line;
+            lt &= ~line;
+            int p = pos + lowest(nl);
+            end(p - m_cur.offset);
+            start(p + 1);
+            nl &= nl - 1;
+        }
+    }
+
+    // the last line has no newline, an empty one after a trailing newline
+    void finish(int size)
+    {
+        end(size - m_cur.offset);
+    }
+
+private:
+    const char         *m_data;
+    QVector<LineInfo>  *m_lines;
+    LineInfo            m_cur;
+
+    static inline int lowest(quint64 bits)
+    {
+#if defined(Q_CC_MSVC)
+        unsigned long bit;
+        _BitScanForward64(&bit, bits);
+        return static_cast<int>(bit);
+#else
+        return __builtin_ctzll(bits);
+#endif
+    }
+
+    inline void first(int *field, int pos, quint64 bits)
+    {
+        if (bits && (*field < 0))
+            *field = pos + lowest(bits) - m_cur.offset;
+    }
+
+    inline void start(int offset)
+    {
+        m_cur.offset = offset;
+        m_cur.open = -1;
+        m_cur.close = -1;
+        m_cur.eq = -1;
+        m_cur.valueEnd = -1;
+        m_cur.lt = -1;
+    }
+
+    inline void end(int length)
+    {
+        m_cur.length = length;
+        if (m_cur.valueEnd < 0)
+            m_cur.valueEnd = length;
+        m_lines->append(m_cur);
+    }
+};
+
+inline bool interesting(char ch)
+{
+    return (ch == '\n') || (ch == '{') || (ch == '}') || (ch == '=') || (ch == '<');
+}
+
+void classifyScalar(const char *data, int from, int size, Lines *lines)
+{
+    for (int i=from; i<size; ++i) {
+        if (interesting(data[i]))
+            lines->mark(i);
+    }
+}
+
+#ifdef LINECLASSIFIER_SIMD
+
+// bit i set where p[i] == ch, for 64 characters
+inline quint64 mask64(const __m128i v[4], char ch)
+{
+    const __m128i c = _mm_set1_epi8(ch);
+    quint64 m = 0;
+    for (int k=0; k<4; ++k)
+        m |= static_cast<quint64>(static_cast<quint32>(_mm_movemask_epi8(_mm_cmpeq_epi8(v[k], c)))) << (16*k);
+    return m;
+}
+
+void classifySse2(const char *data, int size, Lines *lines)
+{
+    int i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m128i v[4];
+        for (int k=0; k<4; ++k)
+            v[k] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16*k));
+        lines->block(i, mask64(v, '\n'), mask64(v, '{'), mask64(v, '}'), mask64(v, '='), mask64(v, '<'));
+    }
+    classifyScalar(data, i, size, lines);
+}
+
+TARGET_AVX2 inline quint64 mask64(const __m256i v[2], char ch)
+{
+    const __m256i c = _mm256_set1_epi8(ch);
+    quint64 lo = static_cast<quint32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v[0], c)));
+    quint64 hi = static_cast<quint32>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(v[1], c)));
+    return lo | (hi << 32);
+}
+
+TARGET_AVX2 void classifyAvx2(const char *data, int size, Lines *lines)
+{
+    int i = 0;
+    for (; i + 64 <= size; i += 64) {
+        __m256i v[2];
+        v[0] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        v[1] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        lines->block(i, mask64(v, '\n'), mask64(v, '{'), mask64(v, '}'), mask64(v, '='), mask64(v, '<'));
+    }
+    classifyScalar(data, i, size, lines);
+}
+
+bool hasAvx2()
+{
+#if defined(Q_CC_MSVC)
+    int r[4];
+    __cpuid(r, 0);
+    if (r[0] < 7)
+        return false;
+    // the OS must save the ymm registers
+    __cpuid(r, 1);
+    if (!(r[2] & (1 << 27)) || !(r[2] & (1 << 28)) || ((_xgetbv(0) & 6) != 6))
+        return false;
+    __cpuidex(r, 7, 0);
+    return (r[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // LINECLASSIFIER_SIMD
+
+Kernel selectKernel()
+{
+    Kernel k = ScalarKernel;
+#ifdef LINECLASSIFIER_SIMD
+    k = hasAvx2() ? Avx2Kernel : Sse2Kernel;
+#endif
+    const QByteArray env = qgetenv("DT_ANNOTATE_KERNEL");
+    if (env == "scalar")
+        k = ScalarKernel;
+    else if ((env == "sse2") && (k > Sse2Kernel))
+        k = Sse2Kernel;
+    return k;
+}
+
+Kernel currentKernel()
+{
+    static const Kernel k = selectKernel();
+    return k;
+}
+
+} // namespace
+
+void LineClassifier::classify(const char *data, int size, QVector<LineInfo> *lines)
+{
+    lines->clear();
+    lines->reserve(size / 32 + 1);
+    Lines l(data, lines);
+    switch (currentKernel()) {
+#ifdef LINECLASSIFIER_SIMD
+    case Avx2Kernel:
+        classifyAvx2(data, size, &l);
+        break;
+    case Sse2Kernel:
+        classifySse2(data, size, &l);
+        break;
+#endif
+    default:
+        classifyScalar(data, 0, size, &l);
+        break;
+    }
+    l.finish(size);
+}
+
+const char *LineClassifier::kernel()
+{
+    switch (currentKernel()) {
+    case Avx2Kernel: return "avx2";
+    case Sse2Kernel: return "sse2";
+    default: break;
+    }
+    return "scalar";
+}
@@ -0,0 +1,41 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// lineclassifier.h
+// header file for lineclassifier.cpp
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef LINECLASSIFIER_H
+#define LINECLASSIFIER_H
+
+#include <QVector>
+
+// structure of one source line, all positions are relative to the start
+// of the line and -1 if the character does not occur
+typedef struct {
+    int offset;     // of the line in the buffer
+    int length;     // without the newline
+    int open;       // first '{', start of a node
+    int close;      // first '}', end of a node
+    int eq;         // first '=', end of a property name
+    int valueEnd;   // second '=' or the end of the line
+    int lt;         // first '<', start of a cell list
+} LineInfo;
+
+namespace LineClassifier {
+
+// split the buffer like QByteArray::split('\n'), an empty buffer is one
+// empty line, and classify every line, all in a single sweep with the
+// fastest kernel of the CPU
+void classify(const char *data, int size, QVector<LineInfo> *lines);
+// kernel in use: "avx2", "sse2" or "scalar". The environment variable
+// DT_ANNOTATE_KERNEL selects a slower one for comparisons
+const char *kernel();
+
+} // namespace LineClassifier
+
+#endif // LINECLASSIFIER_H
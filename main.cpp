@@ -9,11 +9,108 @@
 // 2021-6-8  tt  Initial version created
 // ***************************************************************************
 #include "annotate.h"
+#include "batch.h"
+#include "compressedstream.h"
+#include "server.h"
+#include "treediff.h"
 
 #include <QCoreApplication>
 #include <QCommandLineParser>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
 #include <QDebug>
 
+// statistics of one file as part of the JSON report
+static QJsonObject fileStats(const QString &fnIn, const QString &fnOut, Annotate::ErrCodes err, const Annotate::Statistics &s)
+{
+    QJsonObject o = Annotate::statisticsJson(s);
+    o.insert("input", fnIn);
+    o.insert("output", fnOut);
+    if (err != Annotate::noError)
+        o.insert("error", Annotate::errString(err));
+    return o;
+}
+
+// write the JSON report, "-" for stdout
+static bool writeStats(const QString &fn, const QJsonArray &files)
+{
+    QJsonObject o;
+    o.insert("application", QCoreApplication::applicationName());
+    o.insert("version", QCoreApplication::applicationVersion().trimmed());
+    o.insert("files", files);
+    QByteArray json = QJsonDocument(o).toJson();
+    QFile f;
+    bool ok;
+    if (fn == "-") {
+        ok = f.open(stdout, QIODevice::WriteOnly);
+    } else {
+        f.setFileName(fn);
+        ok = f.open(QFile::Truncate | QIODevice::WriteOnly);
+    }
+    if (!ok || (f.write(json) != json.size())) {
+        qCritical().noquote() << QCoreApplication::translate("main", "cannot write statistics to \"%1\"").arg(fn);
+        return false;
+    }
+    return true;
+}
+
+// a node of a cross-reference index as path and label
+static QString nodeText(const XrefIndex &x, int node)
+{
+    QString s = QString::fromUtf8(x.path(node));
+    if (*x.label(node))
+        s += QString(" (&%1)").arg(QString::fromUtf8(x.label(node)));
+    return s;
+}
+
+// answer reference lookups of labels ("i2c1" or "&i2c1") and paths from
+// a cross-reference index
+static int query(const QString &fn, const QStringList &keys)
+{
+    XrefIndex x;
+    if (!x.open(fn)) {
+        qCritical().noquote() << QCoreApplication::translate("main", "\"%1\" is no valid cross-reference file").arg(fn);
+        return -1;
+    }
+    QTextStream out(stdout);
+    int ret = 0;
+    for (const auto &key : keys) {
+        QByteArray k = key.toUtf8();
+        int node = k.startsWith('/') ? x.findPath(k) : x.findLabel(k.startsWith('&') ? k.mid(1) : k);
+        if (node < 0) {
+            qCritical().noquote() << QCoreApplication::translate("main", "%1: not found").arg(key);
+            ret = -1;
+            continue;
+        }
+        out << nodeText(x, node);
+        if (x.handle(node))
+            out << ", phandle 0x" << QString::number(x.handle(node), 16);
+        out << "\n";
+        for (int i=0; i<x.referencesFrom(node); ++i) {
+            XrefIndex::Reference r = x.referenceFrom(node, i);
+            out << "  " << r.property << " -> ";
+            if (r.node >= 0)
+                out << nodeText(x, r.node) << "\n";
+            else if (*r.label)
+                out << "&" << r.label << " (base tree)\n";
+            else
+                out << "0x" << QString::number(r.handle, 16) << "\n";
+        }
+        for (int i=0; i<x.referencesTo(node); ++i) {
+            XrefIndex::Reference r = x.referenceTo(node, i);
+            out << "  <- " << nodeText(x, r.node) << " " << r.property << "\n";
+        }
+    }
+    return ret;
+}
+
 int main(int argc, char *argv[])
 {
     QCoreApplication a(argc, argv);
@@ -25,25 +122,186 @@ int main(int argc, char *argv[])
     parser.setApplicationDescription("Annotate a reverse-compiled devide tree");
     parser.addHelpOption();
     parser.addVersionOption();
-    parser.addPositionalArgument("in", QCoreApplication::translate("main", "re-compiled device tree source"));
-    parser.addPositionalArgument("out", QCoreApplication::translate("main", "destination for annotated device-tree output"));
+    parser.addPositionalArgument("in", QCoreApplication::translate("main", "re-compiled device tree source or device tree blob (*.dtb, *.dtbo), may be compressed (*.gz, *.xz, *.zst), \"-\" for stdin"));
+    parser.addPositionalArgument("out", QCoreApplication::translate("main", "destination for annotated device-tree output, compressed if named *.gz, *.xz or *.zst, \"-\" for stdout"));
     QCommandLineOption beQiet("q", QCoreApplication::translate("main", "do not output any info"));
     parser.addOption(beQiet);
+    QCommandLineOption batch(QStringList() << "b" << "batch", QCoreApplication::translate("main", "batch mode: all arguments are inputs (files, directories, wildcards or @listfile), annotated in parallel"));
+    parser.addOption(batch);
+    QCommandLineOption jobs(QStringList() << "j" << "jobs", QCoreApplication::translate("main", "number of parallel jobs in batch mode, default is the number of cores"), "n");
+    parser.addOption(jobs);
+    QCommandLineOption threads(QStringList() << "t" << "threads", QCoreApplication::translate("main", "number of threads to annotate a single file, 0 for one per core, default is 1"), "n", "1");
+    parser.addOption(threads);
+    QCommandLineOption outDir(QStringList() << "o" << "output-dir", QCoreApplication::translate("main", "directory for the annotated files in batch mode"), "dir");
+    parser.addOption(outDir);
+    QCommandLineOption maxMemory(QStringList() << "m" << "max-memory", QCoreApplication::translate("main", "memory limit in MiB when streaming from stdin, to stdout or from a compressed file, default is 64"), "MiB", "64");
+    parser.addOption(maxMemory);
+    QCommandLineOption stats("stats", QCoreApplication::translate("main", "print the time per stage, throughput, peak memory, properties by kind and resolved phandles of every file"));
+    parser.addOption(stats);
+    QCommandLineOption statsJson("stats-json", QCoreApplication::translate("main", "write the statistics as JSON to a file, \"-\" for stdout"), "file");
+    parser.addOption(statsJson);
+    QCommandLineOption cache(QStringList() << "c" << "cache", QCoreApplication::translate("main", "incremental mode: keep the annotated top-level nodes in this file and re-annotate only the changed ones"), "file");
+    parser.addOption(cache);
+    QCommandLineOption watch(QStringList() << "w" << "watch", QCoreApplication::translate("main", "annotate again whenever the input file changes, until interrupted"));
+    parser.addOption(watch);
+    QCommandLineOption server(QStringList() << "s" << "server", QCoreApplication::translate("main", "server mode: annotate device trees sent to this local socket, until interrupted"), "name");
+    parser.addOption(server);
+    QCommandLineOption xref(QStringList() << "x" << "xref", QCoreApplication::translate("main", "write an index of all phandle references to this file"), "file");
+    parser.addOption(xref);
+    QCommandLineOption xrefQuery("query", QCoreApplication::translate("main", "query mode: the arguments are labels or paths, list their references from this index"), "file");
+    parser.addOption(xrefQuery);
+    QCommandLineOption diff(QStringList() << "d" << "diff", QCoreApplication::translate("main", "diff mode: compare the nodes and properties of two device trees <in> and <out>, exit code 1 if they differ"));
+    parser.addOption(diff);
+    QCommandLineOption base("base", QCoreApplication::translate("main", "overlay mode: annotate the overlays given as arguments against the labels of this base tree, in parallel like batch mode"), "file");
+    parser.addOption(base);
     parser.process(a);
+    if (parser.isSet(server)) {
+        // one warm annotator for all clients
+        Annotate annotator(parser.isSet(beQiet));
+        annotator.setThreads(parser.value(threads).toInt());
+        Server srv(&annotator, parser.isSet(beQiet));
+        if (!srv.listen(parser.value(server))) {
+            qCritical().noquote() << parser.value(server) + ": " + srv.errorString();
+            return -1;
+        }
+        if (!parser.isSet(beQiet)) {
+            qInfo().noquote() << QCoreApplication::translate("main", "listening on \"%1\"").arg(srv.fullServerName());
+        }
+        return a.exec();
+    }
     QStringList args = parser.positionalArguments();
     if (args.size()==0) {
         parser.showHelp(-2);
     }
+    if (parser.isSet(xrefQuery)) {
+        return query(parser.value(xrefQuery), args);
+    }
+    if (parser.isSet(diff)) {
+        if (args.size() != 2) {
+            qCritical().noquote() << QCoreApplication::translate("main", "--diff needs two device trees");
+            return -2;
+        }
+        TreeDiff d(true, parser.value(threads).toInt());
+        if (!d.run(args[0], args[1])) {
+            qCritical().noquote() << d.errorFile() + ": " + Annotate::errString(d.lastError());
+            return -1;
+        }
+        QFile out;
+        if (!out.open(stdout, QIODevice::WriteOnly) || (out.write(d.report()) != d.report().size()))
+            return -1;
+        out.flush();
+        if (!parser.isSet(beQiet)) {
+            const TreeDiff::Counts &n = d.counts();
+            qInfo().noquote() << QCoreApplication::translate("main", "%1 nodes added, %2 removed, %3 changed, %4 properties differ, %5 nodes compared")
+                                 .arg(n.added).arg(n.removed).arg(n.changed).arg(n.properties).arg(n.compared);
+        }
+        return d.isEqual() ? 0 : 1;
+    }
+
+    if (parser.isSet(batch) || parser.isSet(base)) {
+        if (parser.isSet(cache) || parser.isSet(watch)) {
+            qCritical().noquote() << QCoreApplication::translate("main", "--cache and --watch need a single input and output file");
+            return -2;
+        }
+        // annotate all inputs on a worker pool and report failed files
+        Batch b(parser.isSet(beQiet), parser.value(jobs).toInt());
+        b.setOutputDir(parser.value(outDir));
+        if (parser.isSet(base)) {
+            // the symbols of the base tree are read once and shared by all jobs
+            Annotate annotator(parser.isSet(beQiet));
+            QSharedPointer<Annotate::SymbolTable> symbols(new Annotate::SymbolTable);
+            if (!annotator.loadBase(parser.value(base), symbols.data())) {
+                qCritical().noquote() << parser.value(base) + ": " + annotator.errString();
+                return -1;
+            }
+            b.setBase(symbols);
+        }
+        for (const auto &arg : qAsConst(args)) {
+            b.addInput(arg);
+        }
+        if (parser.isSet(xref)) {
+            // one index for one tree
+            if (b.jobs().size() != 1) {
+                qCritical().noquote() << QCoreApplication::translate("main", "--xref needs a single input in batch and overlay mode");
+                return -2;
+            }
+            b.setXrefFile(parser.value(xref));
+        }
+        int failed = b.run();
+        QJsonArray files;
+        for (const auto &j : b.jobs()) {
+            if (j.err != Annotate::noError) {
+                qCritical().noquote() << j.fnIn + ": " + Annotate::errString(j.err);
+            } else if (parser.isSet(stats)) {
+                qInfo().noquote() << j.fnIn + ":\n" + Annotate::statisticsText(j.stats);
+            }
+            files.append(fileStats(j.fnIn, j.fnOut, j.err, j.stats));
+        }
+        if (!parser.isSet(beQiet)) {
+            qInfo().noquote() << QCoreApplication::translate("main", "annotated %1 of %2 files").arg(b.jobs().size() - failed).arg(b.jobs().size());
+        }
+        if (parser.isSet(statsJson) && !writeStats(parser.value(statsJson), files))
+            return -1;
+        return (failed ? -1 : 0);
+    }
     if (args.size()==1) {
-        args << args[0] + ".annotated";
+        args << ((args[0] == "-") ? args[0] : Compression::annotatedName(args[0]));
     }
 
-    // annotate and exit
-    int ret = 0;
     Annotate annotator(parser.isSet(beQiet));
-    if (!annotator.process(args[0], args[1])) {
-        qCritical() << annotator.errString();
-        ret = -1;
+    annotator.setThreads(parser.value(threads).toInt());
+    annotator.setMaxMemory(parser.value(maxMemory).toLongLong() * 1024 * 1024);
+    annotator.setCacheFile(parser.value(cache));
+    annotator.setXrefFile(parser.value(xref));
+    auto annotate = [&]() -> int {
+        int ret = 0;
+        if (!annotator.process(args[0], args[1])) {
+            qCritical() << annotator.errString();
+            ret = -1;
+        } else if (parser.isSet(stats)) {
+            qInfo().noquote() << Annotate::statisticsText(annotator.statistics());
+        }
+        if (parser.isSet(statsJson)) {
+            QJsonArray files;
+            files.append(fileStats(args[0], args[1], annotator.lastError(), annotator.statistics()));
+            if (!writeStats(parser.value(statsJson), files))
+                ret = -1;
+        }
+        return ret;
+    };
+    if (!parser.isSet(watch)) {
+        // annotate and exit
+        return annotate();
     }
-    return ret;
+
+    if ((args[0] == "-") || (args[1] == "-")) {
+        qCritical().noquote() << QCoreApplication::translate("main", "--watch needs an input and an output file");
+        return -2;
+    }
+    // the state of the last run stays in memory, a change is annotated
+    // as soon as the editor is done with the file. Editors that replace
+    // the file are noticed by watching its directory, too
+    annotator.setIncremental(true);
+    QFileSystemWatcher watcher;
+    QTimer delay;
+    delay.setSingleShot(true);
+    delay.setInterval(10);
+    QObject::connect(&watcher, &QFileSystemWatcher::fileChanged, &delay, static_cast<void (QTimer::*)()>(&QTimer::start));
+    QObject::connect(&watcher, &QFileSystemWatcher::directoryChanged, &delay, static_cast<void (QTimer::*)()>(&QTimer::start));
+    // the directory also changes with the output and the cache file, so
+    // only a new modification time of the input counts
+    QDateTime modified = QFileInfo(args[0]).lastModified();
+    QObject::connect(&delay, &QTimer::timeout, [&]() {
+        QFileInfo fi(args[0]);
+        if (!fi.exists() || (fi.lastModified() == modified))
+            return;
+        modified = fi.lastModified();
+        if (!watcher.files().contains(args[0]))
+            watcher.addPath(args[0]);
+        annotate();
+    });
+    watcher.addPath(QFileInfo(args[0]).absolutePath());
+    watcher.addPath(args[0]);
+    annotate();
+    return a.exec();
 }
@@ -0,0 +1,99 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// nodetree.cpp
+// interned node paths of a device tree
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "nodetree.h"
+#include <string.h>
+
+const int NodeTree::root;
+
+NodeTree::NodeTree()
+{
+    clear();
+}
+
+void NodeTree::clear()
+{
+    m_nodes.clear();
+    m_index.clear();
+    Node n;
+    n.parent = -1;
+    n.symbols = false;
+    n.next = -1;
+    m_nodes.append(n);
+}
+
+uint NodeTree::hash(int parent, const char *name, int len)
+{
+    return qHashBits(name, static_cast<size_t>(len), static_cast<uint>(parent));
+}
+
+int NodeTree::lookup(uint h, int parent, const char *name, int len) const
+{
+    // the nodes are compared with the bytes of the name, no key is built
+    for (int i = m_index.value(h, -1); i >= 0; i = m_nodes[i].next) {
+        const Node &n = m_nodes[i];
+        if ((n.parent == parent) && (n.name.size() == len) && !memcmp(n.name.constData(), name, static_cast<size_t>(len)))
+            return i;
+    }
+    return -1;
+}
+
+int NodeTree::child(int parent, const char *name, int len)
+{
+    // lookups only, as long as all nodes exist, so the annotating threads
+    // may share the tree once it is complete
+    const uint h = hash(parent, name, len);
+    int inx = lookup(h, parent, name, len);
+    if (inx < 0) {
+        Node n;
+        n.parent = parent;
+        n.name = QByteArray(name, len);
+        n.symbols = m_nodes[parent].symbols || n.name.contains("__symbols__");
+        n.next = m_index.value(h, -1);
+        inx = m_nodes.size();
+        m_nodes.append(n);
+        m_index.insert(h, inx);
+    }
+    return inx;
+}
+
+int NodeTree::find(const QByteArray &path) const
+{
+    if (!path.startsWith('/'))
+        return -1;
+    int node = root;
+    int from = 1;
+    if (path.size() == 1)
+        return node;
+    while (node >= 0) {
+        int to = path.indexOf('/', from);
+        if (to < 0)
+            to = path.size();
+        node = lookup(hash(node, path.constData() + from, to - from), node, path.constData() + from, to - from);
+        if (to == path.size())
+            break;
+        from = to + 1;
+    }
+    return node;
+}
+
+QByteArray NodeTree::path(int node) const
+{
+    if (node == root)
+        return "/";
+    QByteArray p;
+    while (node > root) {
+        p.prepend(m_nodes[node].name);
+        p.prepend('/');
+        node = m_nodes[node].parent;
+    }
+    return p;
+}
@@ -0,0 +1,58 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// nodetree.h
+// header file for nodetree.cpp
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef NODETREE_H
+#define NODETREE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+
+// all nodes of a device tree, every node path is stored only once and
+// identified by a small integer
+class NodeTree
+{
+public:
+    NodeTree();
+
+    static const int root = 0;
+
+    void clear();
+    int size() const { return m_nodes.size(); }
+    // the child node with the given name, created if it does not exist yet.
+    // The name is copied only when the node is created
+    int child(int parent, const char *name, int len);
+    int child(int parent, const QByteArray &name) { return child(parent, name.constData(), name.size()); }
+    // the node of a full path, -1 if it does not exist
+    int find(const QByteArray &path) const;
+    const QByteArray &name(int node) const { return m_nodes[node].name; }
+    int parent(int node) const { return m_nodes[node].parent; }
+    // node within a "__symbols__" node
+    bool isSymbols(int node) const { return m_nodes[node].symbols; }
+    // full path text, for diagnostics only
+    QByteArray path(int node) const;
+
+private:
+    typedef struct {
+        int         parent;
+        QByteArray  name;
+        bool        symbols;
+        int         next;       // next node with the same hash, -1 at the end
+    } Node;
+
+    QVector<Node>       m_nodes;
+    QHash<uint, int>    m_index;    // hash of parent and name, first node
+
+    static uint hash(int parent, const char *name, int len);
+    int lookup(uint h, int parent, const char *name, int len) const;
+};
+
+#endif // NODETREE_H
@@ -0,0 +1,248 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// propertytable.h
+// compile-time perfect hash of all property names with special handling
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef PROPERTYTABLE_H
+#define PROPERTYTABLE_H
+
+#include <QtGlobal>
+#include <string.h>
+
+namespace PropertyTable {
+
+typedef enum {
+    Plain = 0,          // no phandles, numbers are converted to decimal
+    SingleHandle,       // a single phandle
+    FirstHandle,        // only the very first parameter is a phandle
+    FirstHandleGpio,    // phandle of a gpio controller and pin
+    ListHandle,         // all parameters are phandles
+    Clocks,             // pairs of phandle and number
+    RockchipPins,
+    RockchipPowerCtrl,
+    Interrupts,
+    InterruptMap,
+    HandlerCount
+} Handler;
+
+typedef struct {
+    const char *name;
+    Handler     handler;
+} Entry;
+
+constexpr Entry entries[] = {
+    { "arasan,soc-ctl-syscon",      SingleHandle },
+    { "audio-supply",               SingleHandle },
+    { "backlight",                  SingleHandle },
+    { "bt656-supply",               SingleHandle },
+    { "center-supply",              SingleHandle },
+    { "charge-dev",                 SingleHandle },
+    { "connect",                    SingleHandle },
+    { "ddr_timing",                 SingleHandle },
+    { "devfreq",                    SingleHandle },
+    { "devfreq-events",             SingleHandle },
+    { "extcon",                     SingleHandle },
+    { "gpio1830-supply",            SingleHandle },
+    { "interrupt-parent",           SingleHandle },
+    { "iommus",                     SingleHandle },
+    { "logo-memory-region",         SingleHandle },
+    { "mali-supply",                SingleHandle },
+    { "memory-region",              SingleHandle },
+    { "mmc-pwrseq",                 SingleHandle },
+    { "native-mode",                SingleHandle },
+    { "operating-points-v2",        SingleHandle },
+    { "phy-supply",                 SingleHandle },
+    { "pmu1830-supply",             SingleHandle },
+    { "rockchip,pmu",               SingleHandle },
+    { "sdmmc-supply",               SingleHandle },
+    { "remote-endpoint",            SingleHandle },
+    { "rockchip,cpu",               SingleHandle },
+    { "rockchip,grf",               SingleHandle },
+    { "rockchip-serial-irq",        SingleHandle },
+    { "secure-memory-region",       SingleHandle },
+    { "simple-audio-card,mclk-fs",  SingleHandle },
+    { "sound-dai",                  SingleHandle },
+    { "trip",                       SingleHandle },
+    { "vbus-supply",                SingleHandle },
+    { "vcc1-supply",                SingleHandle },
+    { "vcc10-supply",               SingleHandle },
+    { "vcc11-supply",               SingleHandle },
+    { "vcc12-supply",               SingleHandle },
+    { "vcc2-supply",                SingleHandle },
+    { "vcc3-supply",                SingleHandle },
+    { "vcc4-supply",                SingleHandle },
+    { "vcc5-supply",                SingleHandle },
+    { "vcc6-supply",                SingleHandle },
+    { "vcc7-supply",                SingleHandle },
+    { "vcc8-supply",                SingleHandle },
+    { "vcc9-supply",                SingleHandle },
+    { "vddio-supply",               SingleHandle },
+    { "vin-supply",                 SingleHandle },
+    { "vmmc-supply",                SingleHandle },
+    { "vqmmc-supply",               SingleHandle },
+    { "vref-supply",                SingleHandle },
+
+    { "assigned-clock-parents",     FirstHandle },
+    { "cooling-device",             FirstHandle },
+    { "discharge-gpios",            FirstHandleGpio },
+    { "ep-gpios",                   FirstHandleGpio },
+    { "gpio",                       FirstHandleGpio },
+    { "gpios",                      FirstHandleGpio },
+    { "headset_gpio",               FirstHandleGpio },
+    { "hp_ctrl_gpio",               FirstHandleGpio },
+    { "int-n-gpios",                FirstHandleGpio },
+    { "io-channels",                FirstHandle },
+    { "linein_det_gpio",            FirstHandleGpio },
+    { "power-domains",              FirstHandle },
+    { "pwms",                       FirstHandle },
+    { "reset-gpios",                FirstHandleGpio },
+    { "rockchip,gpios",             FirstHandleGpio },
+    { "snps,reset-gpio",            FirstHandleGpio },
+    { "thermal-sensors",            FirstHandle },
+    { "typec0-enable-gpios",        FirstHandleGpio },
+    { "vbus-5v-gpios",              FirstHandleGpio },
+    { "vsel-gpios",                 FirstHandleGpio },
+
+    { "nvmem-cells",                ListHandle },
+    { "phys",                       ListHandle },
+    { "pinctrl-0",                  ListHandle },
+    { "pinctrl-1",                  ListHandle },
+    { "pinctrl-2",                  ListHandle },
+    { "pinctrl-3",                  ListHandle },
+    { "pinctrl-4",                  ListHandle },
+    { "pinctrl-5",                  ListHandle },
+    { "pm_qos",                     ListHandle },
+    { "ports",                      ListHandle },
+    { "rockchip,codec",             ListHandle },
+
+    { "clocks",                     Clocks },
+    { "dmas",                       Clocks },
+    { "assigned-clocks",            Clocks },
+    { "rockchip,pins",              RockchipPins },
+    { "rockchip,power-ctrl",        RockchipPowerCtrl },
+    { "interrupts",                 Interrupts },
+    { "interrupt-map",              InterruptMap }
+};
+
+namespace detail {
+
+constexpr int entryCount = sizeof(entries) / sizeof(entries[0]);
+constexpr int bucketBits = 6;
+constexpr int buckets = 1 << bucketBits;
+constexpr int slotBits = 8;
+constexpr int slotCount = 1 << slotBits;
+static_assert(entryCount < slotCount / 2, "property table too small");
+
+constexpr int length(const char *s)
+{
+    int n = 0;
+    while (s[n])
+        ++n;
+    return n;
+}
+
+// FNV-1a, the only pass over the name
+constexpr quint64 hash(const char *s, int len)
+{
+    quint64 h = 0xcbf29ce484222325ULL;
+    for (int i=0; i<len; ++i) {
+        h ^= static_cast<uchar>(s[i]);
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+constexpr int bucket(quint64 h)
+{
+    return static_cast<int>(h & (buckets - 1));
+}
+
+constexpr int slot(quint64 h, quint32 seed)
+{
+    return static_cast<int>(((h ^ seed) * 0x9e3779b97f4a7c15ULL) >> (64 - slotBits));
+}
+
+typedef struct {
+    quint32 seeds[buckets];
+    qint16  index[slotCount];    // index into entries, -1 if unused
+    bool    valid;
+} Table;
+
+// hash and displace: the buckets are placed largest first, each with the
+// first seed that moves all of its names to free slots
+constexpr Table build()
+{
+    Table t {};
+    for (int i=0; i<slotCount; ++i)
+        t.index[i] = -1;
+    int size[buckets] {};
+    for (int i=0; i<entryCount; ++i)
+        ++size[bucket(hash(entries[i].name, length(entries[i].name)))];
+    bool done[buckets] {};
+    for (int n=0; n<buckets; ++n) {
+        int b = -1;
+        for (int i=0; i<buckets; ++i) {
+            if (!done[i] && ((b < 0) || (size[i] > size[b])))
+                b = i;
+        }
+        done[b] = true;
+        if (size[b] == 0)
+            continue;
+        bool placed = false;
+        for (quint32 seed = 1; !placed && (seed < 100000); ++seed) {
+            int used[slotCount] {};
+            int nUsed = 0;
+            placed = true;
+            for (int i=0; placed && (i<entryCount); ++i) {
+                quint64 h = hash(entries[i].name, length(entries[i].name));
+                if (bucket(h) != b)
+                    continue;
+                int s = slot(h, seed);
+                if (t.index[s] >= 0)
+                    placed = false;
+                for (int k=0; k<nUsed; ++k) {
+                    if (used[k] == s)
+                        placed = false;
+                }
+                used[nUsed++] = s;
+            }
+            if (placed) {
+                t.seeds[b] = seed;
+                for (int i=0; i<entryCount; ++i) {
+                    quint64 h = hash(entries[i].name, length(entries[i].name));
+                    if (bucket(h) == b)
+                        t.index[slot(h, seed)] = static_cast<qint16>(i);
+                }
+            }
+        }
+        if (!placed)
+            return t;
+    }
+    t.valid = true;
+    return t;
+}
+
+constexpr Table table = build();
+static_assert(table.valid, "no perfect hash found, duplicate property name?");
+
+} // namespace detail
+
+// classify a property name, one hash and one compare
+inline Handler lookup(const char *name, int len)
+{
+    quint64 h = detail::hash(name, len);
+    int i = detail::table.index[detail::slot(h, detail::table.seeds[detail::bucket(h)])];
+    if ((i >= 0) && (detail::length(entries[i].name) == len) && (memcmp(entries[i].name, name, len) == 0))
+        return entries[i].handler;
+    return Plain;
+}
+
+} // namespace PropertyTable
+
+#endif // PROPERTYTABLE_H
@@ -0,0 +1,83 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// server.cpp
+// annotate device trees of many clients in one process
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "server.h"
+#include <QLocalSocket>
+#include <QDataStream>
+#include <QDebug>
+
+Server::Server(Annotate *annotator, bool beQuiet)
+    : m_annotator(annotator)
+    , m_beQuiet(beQuiet)
+{
+    QObject::connect(&m_server, &QLocalServer::newConnection, &m_server, [this]() { newConnection(); });
+}
+
+bool Server::listen(const QString &name)
+{
+    m_server.setSocketOptions(QLocalServer::UserAccessOption);
+    if (m_server.listen(name))
+        return true;
+    if (m_server.serverError() != QAbstractSocket::AddressInUseError)
+        return false;
+    // the name is taken over only from a server that crashed and left its
+    // socket behind, never from one that still accepts connections
+    QLocalSocket probe;
+    probe.connectToServer(name);
+    if (probe.waitForConnected(1000)) {
+        probe.disconnectFromServer();
+        return false;
+    }
+    QLocalServer::removeServer(name);
+    return m_server.listen(name);
+}
+
+QString Server::errorString() const
+{
+    return m_server.errorString();
+}
+
+QString Server::fullServerName() const
+{
+    return m_server.fullServerName();
+}
+
+void Server::newConnection()
+{
+    while (QLocalSocket *socket = m_server.nextPendingConnection()) {
+        QObject::connect(socket, &QLocalSocket::disconnected, socket, &QObject::deleteLater);
+        QObject::connect(socket, &QLocalSocket::readyRead, socket, [this, socket]() { readRequests(socket); });
+    }
+}
+
+void Server::readRequests(QLocalSocket *socket)
+{
+    // the requests are annotated one after the other, each of them with
+    // all threads of the annotator
+    QDataStream ds(socket);
+    ds.setVersion(QDataStream::Qt_5_12);
+    for (;;) {
+        // a request may arrive in many parts
+        ds.startTransaction();
+        QByteArray in;
+        ds >> in;
+        if (!ds.commitTransaction())
+            return;
+        QByteArray out;
+        if (m_annotator->annotate(in, &out)) {
+            ds << static_cast<qint32>(Annotate::noError) << out;
+            if (!m_beQuiet)
+                qInfo().noquote() << QObject::tr("annotated %1 bytes").arg(in.size());
+        } else {
+            ds << static_cast<qint32>(m_annotator->lastError()) << m_annotator->errString().toUtf8();
+        }
+    }
+}
@@ -0,0 +1,43 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// server.h
+// header file for server.cpp
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "annotate.h"
+#include <QLocalServer>
+#include <QString>
+
+class QLocalSocket;
+
+// annotate device trees sent over a local socket with one long-lived
+// Annotate instance. Every request is a QByteArray in QDataStream format
+// with the source or blob, the reply is the error code as qint32 and a
+// QByteArray with the annotated source or the error text
+class Server
+{
+public:
+    Server(Annotate *annotator, bool beQuiet = false);
+
+    bool listen(const QString &name);
+    QString errorString() const;
+    QString fullServerName() const;
+
+private:
+    Annotate       *m_annotator;
+    bool            m_beQuiet;
+    QLocalServer    m_server;
+
+    void newConnection();
+    void readRequests(QLocalSocket *socket);
+};
+
+#endif // SERVER_H
@@ -0,0 +1,132 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// sourcebuffer.cpp
+// memory mapped input file with a compact line index
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "sourcebuffer.h"
+#include <limits>
+#include <string.h>
+
+SourceBuffer::SourceBuffer()
+    : m_map(nullptr)
+    , m_data(nullptr)
+    , m_size(0)
+{
+}
+
+SourceBuffer::~SourceBuffer()
+{
+    close();
+}
+
+bool SourceBuffer::open(const QString &fn)
+{
+    close();
+    m_file.setFileName(fn);
+    if (!m_file.open(QFile::ReadOnly))
+        return false;
+    qint64 n = m_file.size();
+    if ((n > 0) && (n <= std::numeric_limits<int>::max())) {
+        // map the whole file, pages are loaded on demand by the OS
+        m_map = m_file.map(0, n);
+    }
+    if (m_map) {
+        m_data = reinterpret_cast<const char*>(m_map);
+        m_size = static_cast<int>(n);
+    } else {
+        // mapping not possible (pipe, special file, ...), fall back to reading
+        m_buffer = m_file.readAll();
+        m_data = m_buffer.constData();
+        m_size = m_buffer.size();
+    }
+    buildIndex();
+    return true;
+}
+
+void SourceBuffer::setData(const QByteArray &data)
+{
+    close();
+    m_buffer = data;
+    m_data = m_buffer.constData();
+    m_size = m_buffer.size();
+    buildIndex();
+}
+
+void SourceBuffer::append(const char *data, int size)
+{
+    if (m_offsets.isEmpty())
+        m_offsets.append(0);
+    int from = m_buffer.size();
+    m_buffer.append(data, size);
+    m_data = m_buffer.constData();
+    m_size = m_buffer.size();
+    for (const char *p = m_data + from; (p = static_cast<const char*>(memchr(p, '\n', m_data + m_size - p))) != nullptr; ++p)
+        m_offsets.append(static_cast<int>(p - m_data) + 1);
+}
+
+void SourceBuffer::close()
+{
+    m_offsets.clear();
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+    m_buffer.clear();
+    m_data = nullptr;
+    m_size = 0;
+    if (m_file.isOpen())
+        m_file.close();
+}
+
+QByteArray SourceBuffer::line(int inx) const
+{
+    int offset = m_offsets[inx];
+    int end = (inx + 1 < m_offsets.size()) ? m_offsets[inx + 1] - 1 : m_size;
+    return QByteArray::fromRawData(m_data + offset, end - offset);
+}
+
+void SourceBuffer::classify(int first, int last, QVector<LineInfo> *lines) const
+{
+    // the newline before the start of line last yields one more, empty line
+    int from = lineOffset(first);
+    LineClassifier::classify(m_data + from, lineOffset(last) - from, lines);
+    if (last < m_offsets.size())
+        lines->removeLast();
+    for (auto &info : *lines)
+        info.offset += from;
+}
+
+void SourceBuffer::buildIndex()
+{
+    // same line splitting as QByteArray::split('\n'): a trailing newline
+    // yields an empty last line
+    int n = 1;
+    for (const char *p = m_data; (p = static_cast<const char*>(memchr(p, '\n', m_data + m_size - p))) != nullptr; ++p)
+        ++n;
+    m_offsets.reserve(n);
+    m_offsets.append(0);
+    for (const char *p = m_data; (p = static_cast<const char*>(memchr(p, '\n', m_data + m_size - p))) != nullptr; ++p)
+        m_offsets.append(static_cast<int>(p - m_data) + 1);
+}
+
+LineWindow::LineWindow(const SourceBuffer &src, int size)
+    : m_src(src)
+    , m_size(size)
+    , m_first(0)
+{
+}
+
+const LineInfo &LineWindow::info(int inx)
+{
+    if ((inx < m_first) || (inx >= m_first + m_lines.size())) {
+        m_first = inx;
+        m_src.classify(inx, qMin(inx + m_size, m_src.lineCount()), &m_lines);
+    }
+    return m_lines[inx - m_first];
+}
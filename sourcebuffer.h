@@ -0,0 +1,73 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// sourcebuffer.h
+// zero-copy, line indexed access to an input file
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef SOURCEBUFFER_H
+#define SOURCEBUFFER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QVector>
+#include "lineclassifier.h"
+
+class SourceBuffer
+{
+public:
+    SourceBuffer();
+    ~SourceBuffer();
+
+    bool open(const QString &fn);
+    void setData(const QByteArray &data);
+    // data read block by block, the lines are indexed as they are appended
+    void reserve(int size) { m_buffer.reserve(size); }
+    void append(const char *data, int size);
+    void close();
+
+    const char *data() const { return m_data; }
+    int size() const { return m_size; }
+    bool isEmpty() const { return m_size == 0; }
+    int lineCount() const { return m_offsets.size(); }
+    // the returned array references the source buffer, no data is copied
+    QByteArray line(int inx) const;
+    int lineOffset(int inx) const { return (inx < m_offsets.size()) ? m_offsets[inx] : m_size; }
+    // braces, '=' and '<' of the lines [first, last). Only the start of
+    // the lines is indexed, a LineInfo is seven times as large
+    void classify(int first, int last, QVector<LineInfo> *lines) const;
+
+private:
+    QFile           m_file;
+    uchar          *m_map;
+    QByteArray      m_buffer;
+    const char     *m_data;
+    int             m_size;
+    QVector<int>    m_offsets;
+
+    void buildIndex();
+};
+
+// the classified lines of a source, a window of consecutive lines at a
+// time. Lines are best visited in ascending order
+class LineWindow
+{
+public:
+    explicit LineWindow(const SourceBuffer &src, int size = 65536);
+
+    int lineCount() const { return m_src.lineCount(); }
+    QByteArray line(int inx) const { return m_src.line(inx); }
+    const LineInfo &info(int inx);
+
+private:
+    const SourceBuffer &m_src;
+    int             m_size;
+    int             m_first;
+    QVector<LineInfo> m_lines;
+};
+
+#endif // SOURCEBUFFER_H
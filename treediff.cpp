@@ -0,0 +1,256 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// treediff.cpp
+// structural diff of two device trees with hashed subtrees
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "treediff.h"
+#include "lineclassifier.h"
+#include <QCryptographicHash>
+#include <QHash>
+#include <QThreadPool>
+#include <ctype.h>
+
+TreeDiff::TreeDiff(bool beQuiet, int threads)
+    : m_beQuiet(beQuiet)
+    , m_threads(threads)
+    , m_lastError(Annotate::noError)
+    , m_counts()
+{
+}
+
+bool TreeDiff::run(const QString &fnOld, const QString &fnNew)
+{
+    m_lastError = Annotate::noError;
+    m_errorFile.clear();
+    const QString fn[2] = { fnOld, fnNew };
+    QByteArray in[2];
+    for (int i=0; i<2; ++i) {
+        // compressed files like in all other modes
+        m_lastError = Annotate::readAll(fn[i], &in[i]);
+        if (m_lastError != Annotate::noError) {
+            m_errorFile = fn[i];
+            return false;
+        }
+    }
+    // both trees at the same time, the property rules are shared anyway
+    QByteArray out[2];
+    Annotate::ErrCodes err[2];
+    QThreadPool pool;
+    bool beQuiet = m_beQuiet;
+    int threads = m_threads;
+    auto annotate = [&in, &out, &err, beQuiet, threads](int i) {
+        Annotate annotator(beQuiet);
+        annotator.setThreads(threads);
+        annotator.setPathReferences(true);
+        annotator.annotate(in[i], &out[i]);
+        err[i] = annotator.lastError();
+    };
+    pool.start([&annotate]() { annotate(0); });
+    annotate(1);
+    pool.waitForDone();
+    for (int i=0; i<2; ++i) {
+        if (err[i] != Annotate::noError) {
+            m_lastError = err[i];
+            m_errorFile = fn[i];
+            return false;
+        }
+    }
+    compare(out[0], out[1]);
+    return true;
+}
+
+void TreeDiff::compare(const QByteArray &oldSource, const QByteArray &newSource)
+{
+    m_report.clear();
+    m_counts = Counts();
+    Tree a, b;
+    parse(oldSource, &a);
+    parse(newSource, &b);
+    compareNodes(a, 0, b, 0, QByteArray());
+}
+
+void TreeDiff::parse(const QByteArray &source, Tree *t)
+{
+    t->source = source;
+    t->nodes.resize(1);
+    t->nodes[0].parent = -1;
+    t->nodes[0].firstProperty = 0;
+    t->nodes[0].properties = 0;
+    // properties of a node are collected until its end, the children's
+    // properties come in between
+    QVector<int> stack(1, 0);
+    QVector<QVector<Property> > pending(1);
+    QVector<LineInfo> lines;
+    LineClassifier::classify(source.constData(), source.size(), &lines);
+    bool comment = false;
+    auto finish = [t, &pending](int n) {
+        Node &node = t->nodes[n];
+        node.firstProperty = t->properties.size();
+        node.properties = pending.last().size();
+        QCryptographicHash h(QCryptographicHash::Md5);
+        h.addData(node.label + ": " + node.name + " {\n");
+        for (const auto &p : qAsConst(pending.last())) {
+            h.addData(t->source.constData() + p.pos, p.len);
+            h.addData("\n", 1);
+            t->properties.append(p);
+        }
+        for (int c : qAsConst(node.children))
+            h.addData(t->nodes[c].hash);
+        node.hash = h.result();
+    };
+    for (const auto &info : qAsConst(lines)) {
+        int from = info.offset;
+        int to = info.offset + info.length;
+        while ((from < to) && isspace(static_cast<uchar>(source.at(from))))
+            ++from;
+        while ((to > from) && isspace(static_cast<uchar>(source.at(to-1))))
+            --to;
+        const QByteArray l = QByteArray::fromRawData(source.constData() + from, to - from);
+        if (comment || l.startsWith("/*")) {
+            // the header with the time of the annotation
+            comment = !l.contains("*/");
+            continue;
+        }
+        if (l.isEmpty())
+            continue;
+        if (l.endsWith('{')) {
+            Node n;
+            n.parent = stack.last();
+            n.firstProperty = 0;
+            n.properties = 0;
+            QByteArray name = l.left(l.size() - 1).trimmed();
+            int i = name.lastIndexOf(": ");
+            if (i >= 0) {
+                n.label = name.left(i);
+                name = name.mid(i + 2);
+            }
+            n.name = name;
+            t->nodes[n.parent].children.append(t->nodes.size());
+            stack.append(t->nodes.size());
+            t->nodes.append(n);
+            pending.append(QVector<Property>());
+        } else if ((l == "};") && (stack.size() > 1)) {
+            finish(stack.last());
+            stack.removeLast();
+            pending.removeLast();
+        } else {
+            Property p;
+            p.pos = from;
+            p.len = l.size();
+            int eq = l.indexOf('=');
+            p.nameLen = (eq < 0) ? l.size() - (l.endsWith(';') ? 1 : 0) : eq;
+            while ((p.nameLen > 0) && isspace(static_cast<uchar>(l.at(p.nameLen-1))))
+                --p.nameLen;
+            // references are compared by label or path, the numbers do not matter
+            if (name(*t, p).endsWith("phandle"))
+                continue;
+            pending.last().append(p);
+        }
+    }
+    // unterminated nodes of a broken source
+    while (!stack.isEmpty()) {
+        finish(stack.last());
+        stack.removeLast();
+        pending.removeLast();
+    }
+}
+
+QByteArray TreeDiff::childPath(const QByteArray &path, const Node &child) const
+{
+    if (path.isEmpty())
+        return child.name;
+    return (path == "/") ? "/" + child.name : path + "/" + child.name;
+}
+
+void TreeDiff::reportNode(char op, const QByteArray &path, const Node &n)
+{
+    m_report += op;
+    m_report += ' ';
+    m_report += path;
+    if (!n.label.isEmpty())
+        m_report += " (&" + n.label + ")";
+    m_report += '\n';
+}
+
+void TreeDiff::compareNodes(const Tree &a, int na, const Tree &b, int nb, const QByteArray &path)
+{
+    ++m_counts.compared;
+    const Node &x = a.nodes[na];
+    const Node &y = b.nodes[nb];
+    if (x.hash == y.hash)
+        return;
+    QByteArray lines;
+    if (x.label != y.label)
+        lines += "    label: " + (x.label.isEmpty() ? QByteArray("-") : x.label) + " -> " + (y.label.isEmpty() ? QByteArray("-") : y.label) + "\n";
+    compareProperties(a, na, b, nb, &lines);
+    if (!lines.isEmpty()) {
+        ++m_counts.changed;
+        reportNode('~', path.isEmpty() ? QByteArray("(top level)") : path, y);
+        m_report += lines;
+    }
+    // children are matched by name, which is unique within a node
+    QHash<QByteArray, int> old;
+    for (int c : x.children)
+        old.insert(a.nodes[c].name, c);
+    for (int c : y.children) {
+        const Node &child = b.nodes[c];
+        int o = old.value(child.name, -1);
+        if (o < 0) {
+            ++m_counts.added;
+            reportNode('+', childPath(path, child), child);
+        } else {
+            old.remove(child.name);
+            compareNodes(a, o, b, c, childPath(path, child));
+        }
+    }
+    for (int c : x.children) {
+        const Node &child = a.nodes[c];
+        if (old.contains(child.name)) {
+            ++m_counts.removed;
+            reportNode('-', childPath(path, child), child);
+        }
+    }
+}
+
+void TreeDiff::compareProperties(const Tree &a, int na, const Tree &b, int nb, QByteArray *lines)
+{
+    const Node &x = a.nodes[na];
+    const Node &y = b.nodes[nb];
+    // a property given twice is overridden by the later one, as in dtc
+    QHash<QByteArray, int> old, cur;
+    for (int i=x.firstProperty; i<x.firstProperty+x.properties; ++i)
+        old.insert(name(a, a.properties[i]), i);
+    for (int i=y.firstProperty; i<y.firstProperty+y.properties; ++i)
+        cur.insert(name(b, b.properties[i]), i);
+    for (int i=y.firstProperty; i<y.firstProperty+y.properties; ++i) {
+        const QByteArray n = name(b, b.properties[i]);
+        if (cur.value(n) != i)
+            continue;
+        const QByteArray t = text(b, b.properties[i]);
+        int o = old.value(n, -1);
+        if (o < 0) {
+            ++m_counts.properties;
+            *lines += "    + " + t + "\n";
+        } else {
+            const QByteArray ot = text(a, a.properties[o]);
+            if (ot != t) {
+                ++m_counts.properties;
+                *lines += "    - " + ot + "\n";
+                *lines += "    + " + t + "\n";
+            }
+        }
+    }
+    for (int i=x.firstProperty; i<x.firstProperty+x.properties; ++i) {
+        const QByteArray n = name(a, a.properties[i]);
+        if ((old.value(n) == i) && !cur.contains(n)) {
+            ++m_counts.properties;
+            *lines += "    - " + text(a, a.properties[i]) + "\n";
+        }
+    }
+}
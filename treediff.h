@@ -0,0 +1,93 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// treediff.h
+// header file for treediff.cpp
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef TREEDIFF_H
+#define TREEDIFF_H
+
+#include "annotate.h"
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+
+// structural comparison of two device trees. Both are annotated, with
+// references to nodes without a label written as paths, so renumbered
+// phandles make no difference. Every node gets a hash of its properties
+// and of the hashes of its children, and only subtrees with different
+// hashes are compared
+class TreeDiff
+{
+public:
+    TreeDiff(bool beQuiet = false, int threads = 1);
+
+    typedef struct {
+        int added;          // nodes
+        int removed;
+        int changed;        // nodes with changed properties or label
+        int properties;     // added, removed or changed properties
+        int compared;       // nodes visited, identical subtrees are skipped
+    } Counts;
+
+    // annotate both files concurrently and compare them, false on errors
+    bool run(const QString &fnOld, const QString &fnNew);
+    // compare two annotated sources
+    void compare(const QByteArray &oldSource, const QByteArray &newSource);
+    Annotate::ErrCodes lastError() const { return m_lastError; }
+    // file of the last error
+    const QString &errorFile() const { return m_errorFile; }
+    bool isEqual() const { return m_report.isEmpty(); }
+    // "+ path", "- path" for added and removed nodes, "~ path" for changed
+    // nodes followed by their added, removed and changed properties
+    const QByteArray &report() const { return m_report; }
+    const Counts &counts() const { return m_counts; }
+
+private:
+    typedef struct {
+        int             parent;
+        QByteArray      name;
+        QByteArray      label;
+        QVector<int>    children;
+        int             firstProperty;  // range in the property list
+        int             properties;
+        QByteArray      hash;
+    } Node;
+
+    // the trimmed line in the source
+    typedef struct {
+        int             pos;
+        int             len;
+        int             nameLen;
+    } Property;
+
+    // nodes and properties of one source, node 0 holds everything
+    // outside of the nodes
+    typedef struct {
+        QByteArray          source;
+        QVector<Node>       nodes;
+        QVector<Property>   properties;
+    } Tree;
+
+    bool            m_beQuiet;
+    int             m_threads;
+    Annotate::ErrCodes m_lastError;
+    QString         m_errorFile;
+    QByteArray      m_report;
+    Counts          m_counts;
+
+    void parse(const QByteArray &source, Tree *t);
+    void compareNodes(const Tree &a, int na, const Tree &b, int nb, const QByteArray &path);
+    void compareProperties(const Tree &a, int na, const Tree &b, int nb, QByteArray *lines);
+    static QByteArray text(const Tree &t, const Property &p) { return QByteArray::fromRawData(t.source.constData() + p.pos, p.len); }
+    static QByteArray name(const Tree &t, const Property &p) { return QByteArray::fromRawData(t.source.constData() + p.pos, p.nameLen); }
+    QByteArray childPath(const QByteArray &path, const Node &child) const;
+    void reportNode(char op, const QByteArray &path, const Node &n);
+};
+
+#endif // TREEDIFF_H
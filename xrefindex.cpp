@@ -0,0 +1,407 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// xrefindex.cpp
+// memory mappable index of the phandle references of a device tree
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#include "xrefindex.h"
+#include <QHash>
+#include <QtEndian>
+#include <algorithm>
+#include <limits>
+#include <string.h>
+
+namespace {
+
+const quint32 xrefMagic = 0x52585444;   // "DTXR"
+const quint32 xrefVersion = 2;
+const quint32 none = 0xffffffff;
+
+// words of the header, the tables are given by their byte offset
+typedef enum {
+    MagicWord = 0,
+    VersionWord,
+    NodeCount,
+    EdgeCount,
+    InEdgeCount,            // references with a known node
+    LabelCount,
+    NodeTable,              // parent, name, label, phandle
+    OutIndex,               // first reference of every node and the end
+    EdgeTable,              // from, to, property, phandle, base tree label
+    InIndex,                // first entry of every node in InTable and the end
+    InTable,                // references by referenced node
+    LabelTable,             // nodes sorted by label
+    ChildTable,             // nodes sorted by parent and name
+    StringTable,
+    StringSize,
+    HeaderWords
+} HeaderWord;
+
+const int nodeWords = 4;
+const int edgeWords = 5;
+
+// the file image, all strings are stored only once
+class Writer
+{
+public:
+    Writer() : m_strings(1, '\0') { memset(m_header, 0, sizeof(m_header)); }
+
+    quint32 intern(const QByteArray &s)
+    {
+        auto it = m_offsets.constFind(s);
+        if (it != m_offsets.constEnd())
+            return *it;
+        quint32 offset = static_cast<quint32>(m_strings.size());
+        m_strings += s;
+        m_strings += '\0';
+        m_offsets.insert(s, offset);
+        return offset;
+    }
+    // start of a table, its offset goes to the header
+    void table(HeaderWord w) { m_header[w] = static_cast<quint32>(4*HeaderWords + m_data.size()); }
+    void set(HeaderWord w, quint32 v) { m_header[w] = v; }
+    void add(quint32 v)
+    {
+        char b[4];
+        qToLittleEndian<quint32>(v, b);
+        m_data.append(b, 4);
+    }
+    QByteArray result()
+    {
+        table(StringTable);
+        set(StringSize, static_cast<quint32>(m_strings.size()));
+        set(MagicWord, xrefMagic);
+        set(VersionWord, xrefVersion);
+        QByteArray out(4*HeaderWords, Qt::Uninitialized);
+        for (int i=0; i<HeaderWords; ++i)
+            qToLittleEndian<quint32>(m_header[i], out.data() + 4*i);
+        return out + m_data + m_strings;
+    }
+
+private:
+    quint32     m_header[HeaderWords];
+    QByteArray  m_data;
+    QByteArray  m_strings;
+    QHash<QByteArray, quint32> m_offsets;
+};
+
+} // namespace
+
+XrefIndex::XrefIndex()
+    : m_map(nullptr)
+    , m_data(nullptr)
+    , m_size(0)
+{
+}
+
+XrefIndex::~XrefIndex()
+{
+    close();
+}
+
+QByteArray XrefIndex::build(const NodeTree &tree, const QVector<QByteArray> &labels,
+                            const QVector<quint32> &handles, const QVector<Edge> &edges)
+{
+    Writer w;
+    const int n = tree.size();
+    w.set(NodeCount, static_cast<quint32>(n));
+    w.table(NodeTable);
+    for (int i=0; i<n; ++i) {
+        w.add((i == NodeTree::root) ? none : static_cast<quint32>(tree.parent(i)));
+        w.add(w.intern(tree.name(i)));
+        w.add(w.intern(labels.value(i)));
+        w.add(handles.value(i));
+    }
+
+    // references by referencing node, in order of the source
+    QVector<int> order;
+    for (int i=0; i<edges.size(); ++i) {
+        if ((edges[i].from >= 0) && (edges[i].from < n))
+            order.append(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [&edges](int a, int b) { return edges[a].from < edges[b].from; });
+    w.set(EdgeCount, static_cast<quint32>(order.size()));
+    w.table(OutIndex);
+    int e = 0;
+    for (int i=0; i<=n; ++i) {
+        while ((e < order.size()) && (edges[order[e]].from < i))
+            ++e;
+        w.add(static_cast<quint32>(e));
+    }
+    w.table(EdgeTable);
+    QVector<int> in;
+    for (int i=0; i<order.size(); ++i) {
+        const Edge &r = edges[order[i]];
+        bool known = (r.to >= 0) && (r.to < n);
+        w.add(static_cast<quint32>(r.from));
+        w.add(known ? static_cast<quint32>(r.to) : none);
+        w.add(w.intern(r.property));
+        w.add(r.handle);
+        w.add(w.intern(r.label));
+        if (known)
+            in.append(i);
+    }
+
+    // references by referenced node
+    auto target = [&edges, &order](int i) { return edges[order[i]].to; };
+    std::stable_sort(in.begin(), in.end(), [&target](int a, int b) { return target(a) < target(b); });
+    w.set(InEdgeCount, static_cast<quint32>(in.size()));
+    w.table(InIndex);
+    e = 0;
+    for (int i=0; i<=n; ++i) {
+        while ((e < in.size()) && (target(in[e]) < i))
+            ++e;
+        w.add(static_cast<quint32>(e));
+    }
+    w.table(InTable);
+    for (int i : qAsConst(in))
+        w.add(static_cast<quint32>(i));
+
+    // binary searches by label and by path
+    QVector<int> sorted;
+    for (int i=0; i<n; ++i) {
+        if (!labels.value(i).isEmpty())
+            sorted.append(i);
+    }
+    std::stable_sort(sorted.begin(), sorted.end(), [&labels](int a, int b) { return strcmp(labels[a].constData(), labels[b].constData()) < 0; });
+    w.set(LabelCount, static_cast<quint32>(sorted.size()));
+    w.table(LabelTable);
+    for (int i : qAsConst(sorted))
+        w.add(static_cast<quint32>(i));
+    sorted.clear();
+    for (int i=1; i<n; ++i)
+        sorted.append(i);
+    std::sort(sorted.begin(), sorted.end(), [&tree](int a, int b) {
+        if (tree.parent(a) != tree.parent(b))
+            return tree.parent(a) < tree.parent(b);
+        int r = strcmp(tree.name(a).constData(), tree.name(b).constData());
+        return (r != 0) ? (r < 0) : (a < b);
+    });
+    w.table(ChildTable);
+    for (int i : qAsConst(sorted))
+        w.add(static_cast<quint32>(i));
+    return w.result();
+}
+
+bool XrefIndex::open(const QString &fn)
+{
+    close();
+    m_file.setFileName(fn);
+    if (!m_file.open(QFile::ReadOnly))
+        return false;
+    qint64 n = m_file.size();
+    if ((n > 0) && (n <= std::numeric_limits<int>::max()))
+        m_map = m_file.map(0, n);
+    if (m_map) {
+        m_data = m_map;
+        m_size = static_cast<quint32>(n);
+    } else {
+        m_buffer = m_file.readAll();
+        m_data = reinterpret_cast<const uchar*>(m_buffer.constData());
+        m_size = static_cast<quint32>(m_buffer.size());
+    }
+    if (!validate()) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void XrefIndex::close()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+    m_buffer.clear();
+    m_data = nullptr;
+    m_size = 0;
+    if (m_file.isOpen())
+        m_file.close();
+}
+
+quint32 XrefIndex::header(int inx) const
+{
+    return qFromLittleEndian<quint32>(m_data + 4*inx);
+}
+
+quint32 XrefIndex::at(int table, quint32 inx) const
+{
+    return qFromLittleEndian<quint32>(m_data + header(table) + 4*inx);
+}
+
+const char *XrefIndex::string(quint32 offset) const
+{
+    return reinterpret_cast<const char*>(m_data + header(StringTable) + offset);
+}
+
+bool XrefIndex::validate() const
+{
+    // every offset is checked once, so the lookups need no checks
+    if ((m_size < 4*HeaderWords) || (header(MagicWord) != xrefMagic) || (header(VersionWord) != xrefVersion))
+        return false;
+    const quint64 nodes = header(NodeCount);
+    const quint64 edges = header(EdgeCount);
+    const quint64 inEdges = header(InEdgeCount);
+    const quint64 strings = header(StringSize);
+    auto fits = [this](HeaderWord table, quint64 words) {
+        return (header(table) % 4 == 0) && (header(table) >= 4*HeaderWords) && (header(table) + 4*words <= m_size);
+    };
+    if ((nodes < 1) || !fits(NodeTable, nodeWords*nodes) || !fits(OutIndex, nodes+1) || !fits(EdgeTable, edgeWords*edges)
+            || !fits(InIndex, nodes+1) || !fits(InTable, inEdges) || !fits(LabelTable, header(LabelCount))
+            || !fits(ChildTable, nodes-1) || (strings < 1) || (header(StringTable) + strings > m_size)
+            || (*string(static_cast<quint32>(strings - 1)) != '\0'))
+        return false;
+    for (quint32 i=0; i<nodes; ++i) {
+        quint32 parent = at(NodeTable, nodeWords*i);
+        if (((i == 0) ? (parent != none) : (parent >= i)) || (at(NodeTable, nodeWords*i + 1) >= strings)
+                || (at(NodeTable, nodeWords*i + 2) >= strings))
+            return false;
+    }
+    for (quint32 i=0; i<=nodes; ++i) {
+        if ((at(OutIndex, i) > edges) || (at(InIndex, i) > inEdges) || ((i > 0) && ((at(OutIndex, i) < at(OutIndex, i-1)) || (at(InIndex, i) < at(InIndex, i-1)))))
+            return false;
+    }
+    if ((at(OutIndex, static_cast<quint32>(nodes)) != edges) || (at(InIndex, static_cast<quint32>(nodes)) != inEdges))
+        return false;
+    for (quint32 i=0; i<edges; ++i) {
+        quint32 to = at(EdgeTable, edgeWords*i + 1);
+        if ((at(EdgeTable, edgeWords*i) >= nodes) || ((to != none) && (to >= nodes)) || (at(EdgeTable, edgeWords*i + 2) >= strings)
+                || (at(EdgeTable, edgeWords*i + 4) >= strings))
+            return false;
+    }
+    for (quint32 i=0; i<inEdges; ++i) {
+        if (at(InTable, i) >= edges)
+            return false;
+    }
+    for (quint32 i=0; i<header(LabelCount); ++i) {
+        if (at(LabelTable, i) >= nodes)
+            return false;
+    }
+    for (quint32 i=0; i+1<nodes; ++i) {
+        if (at(ChildTable, i) >= nodes)
+            return false;
+    }
+    return true;
+}
+
+int XrefIndex::nodeCount() const
+{
+    return m_data ? static_cast<int>(header(NodeCount)) : 0;
+}
+
+int XrefIndex::findLabel(const QByteArray &label) const
+{
+    if (!m_data)
+        return -1;
+    quint32 lo = 0;
+    quint32 hi = header(LabelCount);
+    while (lo < hi) {
+        quint32 mid = lo + (hi - lo)/2;
+        int r = strcmp(this->label(static_cast<int>(at(LabelTable, mid))), label.constData());
+        if (r == 0)
+            return static_cast<int>(at(LabelTable, mid));
+        if (r < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return -1;
+}
+
+int XrefIndex::findPath(const QByteArray &path) const
+{
+    if (!m_data || !path.startsWith('/'))
+        return -1;
+    // one binary search per path element
+    quint32 node = NodeTree::root;
+    int from = 1;
+    while (from < path.size()) {
+        int to = path.indexOf('/', from);
+        if (to < 0)
+            to = path.size();
+        const QByteArray name = path.mid(from, to - from);
+        quint32 lo = 0;
+        quint32 hi = header(NodeCount) - 1;
+        int found = -1;
+        while (lo < hi) {
+            quint32 mid = lo + (hi - lo)/2;
+            quint32 child = at(ChildTable, mid);
+            quint32 parent = at(NodeTable, nodeWords*child);
+            int r = (parent != node) ? ((parent < node) ? -1 : 1) : strcmp(string(at(NodeTable, nodeWords*child + 1)), name.constData());
+            if (r == 0) {
+                found = static_cast<int>(child);
+                break;
+            }
+            if (r < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        if (found < 0)
+            return -1;
+        node = static_cast<quint32>(found);
+        from = to + 1;
+    }
+    return static_cast<int>(node);
+}
+
+QByteArray XrefIndex::path(int node) const
+{
+    if (node == NodeTree::root)
+        return "/";
+    QByteArray p;
+    quint32 n = static_cast<quint32>(node);
+    while (n != NodeTree::root) {
+        p.prepend(string(at(NodeTable, nodeWords*n + 1)));
+        p.prepend('/');
+        n = at(NodeTable, nodeWords*n);
+    }
+    return p;
+}
+
+const char *XrefIndex::label(int node) const
+{
+    return string(at(NodeTable, nodeWords*static_cast<quint32>(node) + 2));
+}
+
+quint32 XrefIndex::handle(int node) const
+{
+    return at(NodeTable, nodeWords*static_cast<quint32>(node) + 3);
+}
+
+int XrefIndex::referencesFrom(int node) const
+{
+    return static_cast<int>(at(OutIndex, static_cast<quint32>(node) + 1) - at(OutIndex, static_cast<quint32>(node)));
+}
+
+XrefIndex::Reference XrefIndex::referenceFrom(int node, int inx) const
+{
+    return reference(at(OutIndex, static_cast<quint32>(node)) + static_cast<quint32>(inx), true);
+}
+
+int XrefIndex::referencesTo(int node) const
+{
+    return static_cast<int>(at(InIndex, static_cast<quint32>(node) + 1) - at(InIndex, static_cast<quint32>(node)));
+}
+
+XrefIndex::Reference XrefIndex::referenceTo(int node, int inx) const
+{
+    return reference(at(InTable, at(InIndex, static_cast<quint32>(node)) + static_cast<quint32>(inx)), false);
+}
+
+XrefIndex::Reference XrefIndex::reference(quint32 edge, bool forward) const
+{
+    Reference r;
+    quint32 other = at(EdgeTable, edgeWords*edge + (forward ? 1 : 0));
+    r.node = (other == none) ? -1 : static_cast<int>(other);
+    r.property = string(at(EdgeTable, edgeWords*edge + 2));
+    r.handle = at(EdgeTable, edgeWords*edge + 3);
+    r.label = string(at(EdgeTable, edgeWords*edge + 4));
+    return r;
+}
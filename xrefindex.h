@@ -0,0 +1,83 @@
+// ***************************************************************************
+// Annotate a reverse-compiled device tree
+// ---------------------------------------------------------------------------
+// xrefindex.h
+// header file for xrefindex.cpp
+// ---------------------------------------------------------------------------
+// Copyright (C) 2026 by t2ft - Thomas Thanner
+// Waldstraße 15, 86399 Bobingen, Germany
+// ---------------------------------------------------------------------------
+// 2026-10-17  tt  Initial version created
+// ***************************************************************************
+#ifndef XREFINDEX_H
+#define XREFINDEX_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QVector>
+#include "nodetree.h"
+
+// binary index of the nodes, labels and phandle references of a device
+// tree. The file is used memory mapped as it is: a header of 32 bit words,
+// node records, the references sorted by the referencing node with an
+// index per node, the references by referenced node, the nodes sorted by
+// label and by parent and name for binary searches, and the strings. All
+// numbers are little endian, all strings end with a '\0'
+class XrefIndex
+{
+public:
+    XrefIndex();
+    ~XrefIndex();
+
+    // a reference found while annotating
+    typedef struct {
+        int         from;       // node of the property
+        int         to;         // node with the phandle, -1 if unknown
+        quint32     handle;
+        QByteArray  property;
+        QByteArray  label;      // of a node in the base tree of an overlay, to is -1
+    } Edge;
+
+    // a reference read from the index
+    typedef struct {
+        int         node;       // other end, -1 if unknown
+        quint32     handle;
+        const char *property;
+        const char *label;      // in the base tree of an overlay, empty otherwise
+    } Reference;
+
+    // labels and phandles by node, 0 for a node without phandle
+    static QByteArray build(const NodeTree &tree, const QVector<QByteArray> &labels,
+                            const QVector<quint32> &handles, const QVector<Edge> &edges);
+
+    bool open(const QString &fn);
+    void close();
+    int nodeCount() const;
+    // node by label or by absolute path, -1 if not found
+    int findLabel(const QByteArray &label) const;
+    int findPath(const QByteArray &path) const;
+    QByteArray path(int node) const;
+    const char *label(int node) const;
+    quint32 handle(int node) const;
+    // references of the properties of a node and references to the node
+    int referencesFrom(int node) const;
+    Reference referenceFrom(int node, int inx) const;
+    int referencesTo(int node) const;
+    Reference referenceTo(int node, int inx) const;
+
+private:
+    QFile           m_file;
+    uchar          *m_map;
+    QByteArray      m_buffer;
+    const uchar    *m_data;
+    quint32         m_size;
+
+    // word of the header, of a table the header points to and a string
+    quint32 header(int inx) const;
+    quint32 at(int table, quint32 inx) const;
+    const char *string(quint32 offset) const;
+    Reference reference(quint32 edge, bool forward) const;
+    bool validate() const;
+};
+
+#endif // XREFINDEX_H